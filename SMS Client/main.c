@@ -11,13 +11,32 @@
  *      if timeout, send message to cpu resend message to rf
  ******************************************************************************/
 
-#include  "msp430x20x2.h"
+#include  "msp430g2452.h"
 #include "../SMS Server/rf24g_2.h"
-
-#define OPEN_THRESH (24*1)
+#include "../SMS Server/clock.h"
+#include "../SMS Server/timer.h"
+#include "../SMS Server/door.h"
+#include "../SMS Server/cmd.h"
+#include "../SMS Server/log.h"
+#include "../SMS Server/prof.h"
+#include "../SMS Server/counter.h"
+#include "../SMS Server/info.h"
+
+#ifndef CLIENT_NODE
+#define CLIENT_NODE 1                   //this door's node ID, not SERVER_NODE
+#endif
+#define INFO_NODE   INFO_BYTE(INFO_NODE_ADDR)
+#define DOOR_NODE   (INFO_NODE != 0xFF ? INFO_NODE : CLIENT_NODE) //see door.h
+#ifndef DOOR_HOLD_MS
+#define DOOR_HOLD_MS 1000               //after the last good MSG_OPEN
+#endif
+#define DOOR_TIMER 0
 
 #define     false               0
 #define     true                1
+#ifdef RF_24G_RX2
+#error "RF_24G_RX2 takes P1.0 and P1.6, the door outputs; move the door to a free pin first"
+#endif
 #define     LED0                BIT0
 #define     LED1                BIT6
 #define     LED_DIR             P1DIR
@@ -36,9 +55,7 @@
 #define     TXD                 BIT1                      // TXD on P1.1
 #define     RXD                 BIT2                      // RXD on P1.2
 
-//   Conditions for 9600/4=2400 Baud SW UART, SMCLK = 1MHz
-#define     Bitime_5              0x05*4                      // ~ 0.5 bit length + small adjustment
-#define     Bitime                13*4//0x0D    
+//   Bitime and Bitime_5 for BAUD come from the clock profile, clock.h
 
 #define     TEST 0b01010101
 
@@ -48,23 +65,57 @@ void InitializeButton(void);
 void InitializeSerial(void); 
 void InitializeClocks(void);
 void puts(const char * s);
+unsigned char txFree(void);
 void putc(const char c);
 void putc_i(const char c);
 int getc(char *c);
+int read(char *buf, int len);
 void EchoTest();
 void RFTest();
 void openDoor();
 void closeDoor();
+void reply(uint8_t type, uint32_t counter, uint8_t hop);
 void mainLoop();
+void waitForData();
 
 //private globals and functions
 unsigned int TxData;
-unsigned int RxData;
-char BitCnt;
-volatile int recvFlag=0;
+char TxBitCnt;
+
+//receive ring buffer, filled by Timer_A at the end of each frame. Only PROF
+//reads it, so otherwise RXD isn't listened to at all and none of the receive
+//side is built: an unread ring would just fill up and log overruns.
+//EchoTest needs -DUART_RX.
+#if defined(PROF) && !defined(UART_RX)
+#define     UART_RX
+#endif
+#ifdef UART_RX
+unsigned char RxData;
+char RxBitCnt;
+#define     RX_BUF_SIZE         8                         // power of two, <=128
+#define     RX_BUF_MASK         (RX_BUF_SIZE-1)
+unsigned char rxBuf[RX_BUF_SIZE];
+volatile unsigned char rxHead;                            // free running, written by ISR
+volatile unsigned char rxTail;                            // free running, written by getc
+volatile unsigned char rxOverrun;                         // bytes dropped, buffer full
+#endif
+
+//transmit queue, drained by Timer_A one frame after another. All it has to
+//take without waiting is one log event, see logFlush()
+#define     TX_BUF_SIZE         (LOG_FRAME_MAX+1)
+//CCR0 sending, or CCR1 in a frame: compare mode or a start bit not yet taken
+#define     uartBusy()          ((CCTL0 & CCIE) || ((CCTL1 & CCIE) && (CCTL1 & (CAP+CCIFG)) != CAP))
+unsigned char txBuf[TX_BUF_SIZE];                         // one slot kept empty
+volatile unsigned char txHead;                            // next to fill, written by putc
+volatile unsigned char txTail;                            // next to send, written by TX_Next
+
+uint32_t lastCounter;                                     // rolling code we last opened for, see counter.h
 
 void TX_Byte(void);
+void TX_Next(void);
 void RX_Ready(void);
+void RX_Sleep(void);
+void RX_Wake(void);
 
 
 /*******************************************************************************
@@ -72,17 +123,27 @@ void RX_Ready(void);
  ******************************************************************************/
 void main(void)
 {
-    unsigned char i;
     WDTCTL = WDTPW + WDTHOLD;                 // Stop watchdog timer
     InitializeClocks();
+    if(keyErased()){
+        __bis_SR_register(LPM4_bits);         //no door key to open with, see door.h
+    }
     InitializeButton();
     InitializeLeds();
     InitializeSerial();
+    InitializeTimers();
     RF_24G_init();
-    RF_24G_Config();
+    RF_24G_Config(DOOR_NODE);
+    RF_24G_TxNode = SERVER_NODE;
+    RF_24G_SetChannel(hopChannels[0]);        //until the server says otherwise
+    RF_24G_DR1IntEnable();
+#ifdef RF_24G_RX2
+    RF_24G_DR2IntEnable();
+#endif
+    lastCounter = counterInit();              //the server catches up with MSG_STALE
     __enable_interrupt();                     
 
-    puts("Client.\r\n");
+    LOG(EV_RESET, DOOR_NODE);
 
     //EchoTest(); //doesn't return
     //RFTest();//doesn't return
@@ -91,6 +152,7 @@ void main(void)
     }
 }
 
+#ifdef UART_RX
 void EchoTest()
 {
     char counter='0';
@@ -114,63 +176,120 @@ void EchoTest()
         }
     }
 }
+#endif
 
 void RFTest()
 {
     uint8_t i;
+    uint8_t *pkt;
     RF_24G_SetRx() ;
-    for(i=0; i<RF_24G_PAYLOADSIZE; i++){
-        RF_24G_Buffer[i]=0;
-    }
 
     while(1){
         puts("Waiting");
         while(!hasData());
         puts("Data");
-        getBuffer();
+        pkt = getBuffer();
         for(i=0; i<RF_24G_PAYLOADSIZE; i++){
-            putc_i(RF_24G_Buffer[i]);
+            putc_i(pkt[i]);
         }
     }
 }
 
 void mainLoop()
 {
-    static int now;
-    static int lastOpenTime;
-    static int open;
-    static int count;
-    int i;
-    int correct=1;
+    uint32_t counter;
+    uint8_t hop;
+    uint8_t *pkt;
+#ifdef PROF
+    char inchar;
+#endif
     RF_24G_SetRx() ;
-    puts("Waiting");
+    LOG(EV_WAITING, 0);
     while(!hasData()){
-        if(open){
-            puts("Open      ");
-            count++;
-            if(count>OPEN_THRESH){
-                closeDoor();
-                open=0;
+#ifdef RF_24G_RX2
+        if(hasData2()){
+            getBuffer2();                       //broadcast, nothing to do with it yet
+            LOG(EV_BROADCAST, RF_24G_Buffer2[0]);
+        }
+#endif
+        if(timerExpired(DOOR_TIMER)){
+            closeDoor();
+            LOG(EV_CLOSED, 0);
+        }
+#ifdef PROF
+        while(getc(&inchar)){
+            if(frameRecv(inchar) && frameBuf[1] == CMD_STATUS){
+                profDump(frameBuf[0]);          //no reply, just the table
             }
         }
-    }
-    puts("Signal");
-    getBuffer();
-    for(i=0; i<RF_24G_PAYLOADSIZE; i++){
-        putc_i(RF_24G_Buffer[i]);
-        if(RF_24G_Buffer[i]!=RF_24G_PAYLOADSIZE-i){
-            correct=0;
+#endif
+        if(!uartBusy()){
+            counterErase();                     //~15ms with interrupts off, see counter.h
         }
+        logFlush(txFree());                     //only what fits, DR1 doesn't wait
+        waitForData();
     }
-    if(correct){
+    LOG(EV_SIGNAL, 0);
+    pkt = getBuffer();
+    if(msgType(pkt, DOOR_NODE) != MSG_OPEN){
+        LOG(EV_BAD, pkt[MSG_TYPE]);
+        return;
+    }
+    counter = msgCounter(pkt);
+    hop = msgHop(pkt);
+    if(counter > lastCounter){
+        counterReserve(counter);                //before a reset could forget it
         openDoor();
-        open=1;
-        count=0;
-        lastOpenTime=now;
-        puts("Correct");
+        setTimer(DOOR_TIMER, US_TICKS(DOOR_HOLD_MS * 1000UL));  //every good packet pushes closing back
+        lastCounter = counter;
+        reply(MSG_ACK, counter, hop);           //the server is waiting
+        LOG(EV_CORRECT, counter);
+    }else if(counter == lastCounter){
+        reply(MSG_ACK, counter, hop);           //our ack got lost, the door is open already
+        LOG(EV_REPEAT, counter);
+    }else{
+        reply(MSG_STALE, lastCounter, hop);     //replayed, or the server was reset
+        LOG(EV_STALE, counter);
     }
 }
 
+//answers the server on the channel it came in on, then moves to the server's
+//home channel, hop; leaves the radio in TX until mainLoop listens again
+void reply(uint8_t type, uint32_t counter, uint8_t hop)
+{
+    RF_24G_SetTx();
+    makeMsg(type, counter, hop, DOOR_NODE);
+    putBuffer();
+    RF_24G_SetChannel(hopChannels[hop]);
+}
+
+//Sleeps until DR1 (or DR2) goes high or a timer is due. Timer_A runs the UART and the
+//watchdog runs the timers off SMCLK, so while either is busy only the CPU can
+//stop (LPM0); once both are idle everything but ACLK can.
+void waitForData()
+{
+    __disable_interrupt();
+#ifdef RF_24G_RX2
+    if(!hasData() && !hasData2()){
+#else
+    if(!hasData()){
+#endif
+        if(uartBusy() || timersPending()){
+            __bis_SR_register(LPM0_bits + GIE);     //Timer_A or the watchdog wakes us
+        }else{
+#ifdef UART_RX
+            RX_Sleep();
+#endif
+            __bis_SR_register(LPM3_bits + GIE);     //Port_1 wakes us, DR1 or a start bit
+            __disable_interrupt();
+#ifdef UART_RX
+            RX_Wake();
+#endif
+        }
+    }
+    __enable_interrupt();
+}
+
 void openDoor()
 {
     LED_OUT|=(LED0|LED1);
@@ -183,9 +302,13 @@ void closeDoor()
 void InitializeClocks(void)
 {
 
-    BCSCTL1 = CALBC1_1MHZ;                     // Set range
-    DCOCTL = CALDCO_1MHZ;
-    BCSCTL2 &= ~(DIVS_3);                      // SMCLK = DCO / 8 = 1MHz  
+    if(CALBC1_MCLK == 0xFF){
+        while(1);                              // Calibration erased, see clock.h
+    }
+    BCSCTL1 = CALBC1_MCLK;                     // Set range
+    DCOCTL = CALDCO_MCLK;
+    BCSCTL2 &= ~(DIVS_3);                      // SMCLK = DCO = MCLK_MHZ
+    BCSCTL3 |= LFXT1S_2;                       // ACLK = VLO, no crystal to keep running in LPM3
 }
 
 void InitializeButton(void)              
@@ -209,15 +332,18 @@ void InitializeSerial(void)
 {
     CCTL0 = OUT;                               // TXD Idle as Mark
     //TACTL = TASSEL_1 + MC_2;                 // ACLK, continuous mode --from example file
-    TACTL = TASSEL_2 + MC_2 + ID_3;            // SMCLK/8, continuous mode --from example project that shiped w/ board
-    //P1SEL |= TXD + RXD;                      //
-    P1SEL |= TXD ;                        
+    TACTL = TASSEL_2 + MC_2 + ID_3;            // SMCLK/8 = TACLK_HZ, continuous mode --from example project that shiped w/ board
+    P1SEL |= TXD + RXD;                        // TA0.0 out, CCI1A in
     P1DIR |= TXD;                              // TXD is output
     P1DIR &= ~RXD;                             // RXD is input
-    P1IES=RXD;  //Falling edge
+    P1IES |= RXD;                              // Falling edge, for RX_Sleep
 
-    recvFlag=0;
+    txHead=txTail=0;
+#ifdef UART_RX
+    rxHead=rxTail=0;
+    rxOverrun=0;
     RX_Ready();
+#endif
 }
 
 void puts(const char * s)
@@ -228,11 +354,31 @@ void puts(const char * s)
     }
 }
 
+//bytes putc() can queue without waiting
+unsigned char txFree(void)
+{
+    unsigned char n = txTail;
+    if(n <= txHead){
+        n += TX_BUF_SIZE;
+    }
+    return n - txHead - 1;
+}
+
+//queues c for Timer_A to send, only waits when the queue is full
 void putc(const char c)
 {
-    TxData = c;
-    TX_Byte();  //blocks till completion
-    RX_Ready();
+    unsigned char next = txHead + 1;
+    if(next == TX_BUF_SIZE){
+        next = 0;
+    }
+    while(next == txTail && (CCTL0 & CCIE));   //Timer_A makes room one frame at a time
+    txBuf[txHead] = c;
+    __disable_interrupt();
+    txHead = next;
+    if(!(CCTL0 & CCIE)){
+        TX_Byte();                          //CCR0 is idle, start it up
+    }
+    __enable_interrupt();
 }
 
 /*******************************************************************************
@@ -249,111 +395,178 @@ void putc_i(const char c)
     putc((c%10)+'0');
 }
 
+#ifdef UART_RX
 //returns true if a character was received
 int getc(char *c)
 {
-    if(recvFlag){
-        *c = RxData;
-        recvFlag=false;
+    if(rxHead!=rxTail){
+        *c = rxBuf[rxTail & RX_BUF_MASK];
+        rxTail++;
         return true;
     }else{
         return false;
     }
 }
 
-// Function Transmits Character from TxData Buffer
+//copies up to len received characters into buf, returns how many
+int read(char *buf, int len)
+{
+    int n=0;
+    while(n<len && getc(&buf[n])){
+        n++;
+    }
+    return n;
+}
+#endif
+
+// Function Starts Transmitting the Transmit Queue, CCR0 must be idle
 void TX_Byte (void)
 {
-    BitCnt = 0xA;                             // Load Bit counter, 8data + ST/SP
+    PROF_START(t0);
+    TX_Next();
     while (CCR0 != TAR)                       // Prevent async capture
         CCR0 = TAR;                           // Current state of TA counter
     CCR0 += Bitime;                           // Some time till first bit
+    CCTL0 =  OUTMOD0 + CCIE;                  // TXD = mark = idle
+    PROF_END(PROF_TX_BYTE, t0);
+}
+
+// Function Loads the Next Queued Character into TxData
+void TX_Next (void)
+{
+    TxData = txBuf[txTail];
+    if(++txTail == TX_BUF_SIZE){
+        txTail = 0;
+    }
+    TxBitCnt = 0xA;                           // Load Bit counter, 8data + ST/SP
     TxData |= 0x100;                          // Add mark stop bit 
     TxData = TxData << 1;                     // Add space start bit
-    CCTL0 =  CCIS0 + OUTMOD0 + CCIE;          // TXD = mark = idle
-    while ( CCTL0 & CCIE );                   // Wait for TX completion
 }
 
 
+#ifdef UART_RX
 // Function Readies UART to Receive Character into RxData Buffer
 void RX_Ready (void)
 {
-    BitCnt = 0;                             // Load Bit counter
-    //CCTL0 = SCS + OUTMOD0 + CM1 + CAP + CCIE;   // Sync, Neg Edge, Cap
-    P1IE = RXD;
-    P1IFG &= ~RXD;  //setting IE may trigger IFG, so clear it
+    RxBitCnt = 0;                           // Load Bit counter
+    P1SEL |= RXD;                           // RXD is CCI1A
+    CCTL1 = SCS + CM1 + CAP + CCIE;         // Sync, Neg Edge, Cap
 }
 
-//called from interrupt
-void RecvMode(void)
+//Timer_A stops in LPM3, so a start bit can't be captured there: give RXD to
+//Port_1 to wake us and time that frame from its edge interrupt instead.
+//Call with interrupts off and the UART idle.
+void RX_Sleep(void)
 {
-    //CCTL0 &= ~ CAP;                         // Switch from capture to compare mode
-    CCTL0 = OUTMOD0 + CCIE;   // Sync, Neg Edge, Cap
-    CCR0 = Bitime+TAR;
+    CCTL1 &= ~CCIE;
+    P1SEL &= ~RXD;
+    P1IFG &= ~RXD;
+    P1IE |= RXD;
 }
 
+//back to capture unless Port_1 has a start bit for us, interrupts off
+void RX_Wake(void)
+{
+    if((P1IE & RXD) && !(P1IFG & RXD)){
+        P1IE &= ~RXD;
+        RX_Ready();
+    }
+}
+#endif
+
 // Port 1 interrupt service routine
 #pragma vector=PORT1_VECTOR
 __interrupt void Port_1(void)
 {
-    if(P1IFG & RXD){
-        //got a start bit
-        //RxData is now corrupted, so clear flag
-        recvFlag=0;
+    if(RF_24G_DR1Int()){
+        _BIC_SR_IRQ(LPM3_bits);                 //packet ready, wake up mainLoop
+    }
+#ifdef RF_24G_RX2
+    if(RF_24G_DR2Int()){
+        _BIC_SR_IRQ(LPM3_bits);                 //broadcast ready
+    }
+#endif
+#ifdef UART_RX
+    if(P1IFG & P1IE & RXD){
+        //start bit that woke us from LPM3, see RX_Sleep
         P1IE &= ~RXD;                           //Disable interrupt
-        P1IFG &= ~RXD;                          // P1.4 IFG cleared
-        //enable timer interrupt to receive remaining bits
-        CCTL0 = OUTMOD0 + CCIE;   // Sync, Neg Edge, Cap
-        //Sample the next bit at TAR + Bittime
-        CCR0 = Bitime+TAR;
+        P1IFG &= ~RXD;
+        P1SEL |= RXD;                           //SCCI samples the rest of the frame
+        RxBitCnt = 0;
+        CCTL1 = CCIE;                           //compare mode
+        //Sample the first data bit in its middle, less what it took to get here
+        CCR1 = Bitime+Bitime_5+TAR;
+        _BIC_SR_IRQ(LPM3_bits);                 //Timer_A needs SMCLK for the rest of the frame
     }
+#endif
 }
 
-// Timer A0 interrupt service routine
-#pragma vector=TIMERA0_VECTOR
+// Timer A0 interrupt service routine, CCR0 transmits. CCR1 receives at the
+// same time, in Timer_A1
+#pragma vector=TIMER0_A0_VECTOR
 __interrupt void Timer_A (void)
 {
+    PROF_START(t0);
     CCR0 += Bitime;                                 // Add Offset to CCR0
 
-    // TX
-    if (CCTL0 & CCIS0)                              // TX on CCI0B?
+    if ( TxBitCnt == 0 && txHead != txTail)
+        TX_Next();                                  // Stop bit is out, start the next one
+    if ( TxBitCnt == 0)
     {
-        if ( BitCnt == 0)
-            CCTL0 &= ~ CCIE;                        // All bits TXed, disable interrupt
-        else
-        {
-            CCTL0 |=  OUTMOD2;                      // TX Space
-            if (TxData & 0x01)
-                CCTL0 &= ~ OUTMOD2;                 // TX Mark
-            TxData = TxData >> 1;
-            BitCnt --;
-        }
+        CCTL0 &= ~ CCIE;                            // Queue empty, disable interrupt
+        _BIC_SR_IRQ(LPM3_bits);                     // Wake anyone waiting for the UART
     }
-    // RX
     else
     {
-        if( CCTL0 & CAP )                           // Capture mode = start bit edge
-        {
-            CCTL0 &= ~ CAP;                         // Switch from capture to compare mode
-            CCR0 += Bitime_5;                       //we do this at the top too..wtf?
+        CCTL0 |=  OUTMOD2;                          // TX Space
+        if (TxData & 0x01)
+            CCTL0 &= ~ OUTMOD2;                     // TX Mark
+        TxData = TxData >> 1;
+        TxBitCnt --;
+    }
+    PROF_END(PROF_TIMER_A0, t0);
+}
+
+// Timer A1 interrupt service routine, CCR1 receives. Never enabled without
+// UART_RX
+#pragma vector=TIMER0_A1_VECTOR
+__interrupt void Timer_A1 (void)
+{
+#ifdef UART_RX
+    PROF_START(t0);
+    if(TA0IV != TA0IV_TACCR1)
+        return;
+    if( CCTL1 & CAP )                               // Capture mode = start bit edge
+    {
+        CCTL1 = CCIE;                               // Switch from capture to compare mode
+        CCR1 += Bitime + Bitime/2;                  // CCR1 has the edge, sample mid bit
+        _BIC_SR_IRQ(LPM3_bits);                     // Timer_A needs SMCLK for the rest of the frame
+    }
+    else
+    {
+        CCR1 += Bitime;
+        RxData = RxData >> 1;
+        if(CCTL1 & SCCI){                           // RXD as it was at the compare
+            RxData |= 0x80;
         }
-        else
-        {
-            if(BitCnt<8){                               
-                RxData = RxData >> 1;
-                if(P1IN & RXD){                     // Get bit waiting in receive latch
-                    RxData |= 0x80;                 // input data
-                }
-            }
-            if(BitCnt>=8)
-            {
-                CCTL0 &= ~ CCIE;                    //All bits RXed, disable interrupt
-                //_BIC_SR_IRQ(LPM3_bits);           //Clear LPM3 bits from 0(SR)
-                P1IFG &= ~RXD;                      //for some reason the interrupt flag is set at the end, so clear it
-                recvFlag=1;
-            }
-            BitCnt++;                               
+        if(++RxBitCnt < 8){
+            PROF_END(PROF_TIMER_A1, t0);
+            return;
+        }
+        //All bits RXed. The stop bit isn't checked, so listen for the next
+        //start bit from here: a fast sender's comes early
+        CCTL1 &= ~ CCIE;
+        _BIC_SR_IRQ(LPM3_bits);                     //Clear LPM3 bits from 0(SR)
+        if((unsigned char)(rxHead-rxTail) < RX_BUF_SIZE){
+            rxBuf[rxHead & RX_BUF_MASK] = RxData;
+            rxHead++;
+        }else{
+            rxOverrun++;                            //getc is too slow, drop it
+            LOG(EV_OVERRUN, rxOverrun);
         }
+        RX_Ready();                                 //look for the next start bit right away
     }
+    PROF_END(PROF_TIMER_A1, t0);
+#endif
 }
 
@@ -0,0 +1,49 @@
+//Clock profile, shared by SMS Server and SMS Client. Override on the compiler
+//command line, e.g. -DMCLK_MHZ=16 -DBAUD=38400.
+//
+//MCLK and SMCLK both run straight off the DCO at its info memory calibration.
+//Timer_A counts SMCLK/8 for the software UART: slow enough for TX_Byte() to
+//catch TAR, and Bitime comes out within 0.2% of BAUD wherever it builds. The
+//watchdog tick (TICK_US, timer.h) and the RF-24G clock follow the profile.
+//
+//The G2xx2 parts only ship CALBC1_1MHZ/CALDCO_1MHZ. For 8 or 16MHz write the
+//calibration to info memory segment A first (TI's DCO calibration example
+//does it); InitializeClocks() stops on an erased one.
+
+#ifndef MCLK_MHZ
+#define MCLK_MHZ                1       //1, 8 or 16
+#endif
+#ifndef BAUD
+#define BAUD                    2400    //software UART
+#endif
+
+#if MCLK_MHZ == 1
+#define CALBC1_MCLK             CALBC1_1MHZ
+#define CALDCO_MCLK             CALDCO_1MHZ
+#elif MCLK_MHZ == 8
+#define CALBC1_MCLK             CALBC1_8MHZ
+#define CALDCO_MCLK             CALDCO_8MHZ
+#elif MCLK_MHZ == 16
+#define CALBC1_MCLK             CALBC1_16MHZ
+#define CALDCO_MCLK             CALDCO_16MHZ
+#else
+#error "MCLK_MHZ must be 1, 8 or 16"
+#endif
+
+#define SMCLK_HZ                (MCLK_MHZ * 1000000L)
+#define TACLK_HZ                (SMCLK_HZ / 8)          //TASSEL_2 + ID_3
+
+//Timer_A ticks per bit. CCR1 captures start bit edges, so samples go
+//exactly mid bit from there; Bitime_5 is for a start bit timed from Port_1
+//instead (the one that wakes SMS Client from LPM3): half a bit less the ~48
+//cycles (6 ticks, whatever MCLK is) from the edge to Port_1 reading TAR
+#define Bitime                  ((TACLK_HZ + BAUD/2) / BAUD)
+#define RX_LATENCY              6
+#define Bitime_5                (Bitime/2 > RX_LATENCY ? Bitime/2 - RX_LATENCY : 0)
+
+#if (Bitime * BAUD - TACLK_HZ) * 100 > 2 * TACLK_HZ || (TACLK_HZ - Bitime * BAUD) * 100 > 2 * TACLK_HZ
+#error "BAUD is more than 2% off at this MCLK_MHZ"
+#endif
+#if Bitime < 26
+#error "BAUD is too fast: Timer_A and the main loop need ~200 cycles a bit"
+#endif
@@ -0,0 +1,55 @@
+//Framed binary commands on the server UART, shared with the host gateway.
+//
+//Frames are SLIP encoded: SLIP_END, body, SLIP_END, with END and ESC in the
+//body escaped. A body is
+//      tag, command, arguments..., crc8
+//and every command gets exactly one reply
+//      tag, command|CMD_REPLY, status, data..., crc8
+//The tag is the host's own and comes back in the reply, so it can have
+//several commands in flight. Frames with a bad CRC are dropped and counted;
+//the host finds out by not getting a reply.
+//
+//CRC-8 is polynomial 0x07 (x^8+x^2+x+1), initial value 0, over tag to the
+//last argument.
+
+#define SLIP_END                0xC0
+#define SLIP_ESC                0xDB
+#define SLIP_ESC_END            0xDC
+#define SLIP_ESC_ESC            0xDD
+
+#define FRAME_MAX               5       //command body bytes, CMD_CONFIG's; and a CRC
+#define FRAME_OUT(len)          (2 + 2*((len) + 1))     //line bytes of a body at most,
+                                                        //its CRC and all escaped
+
+#define CMD_OPEN                0x01    //node -> status, then CMD_OPEN|CMD_EVENT
+#define CMD_CLOSE               0x02    //stop an open in progress -> status
+#define CMD_STATUS              0x03    //-> status, flags, tries, counter (4), dropped,
+                                        //   home RF channel
+#define STATUS_LEN              8       //CMD_STATUS data bytes
+#define REPLY_MAX               (3 + STATUS_LEN)    //CMD_STATUS's reply body, no CRC
+#define OPEN_EVENT_LEN          4                   //CMD_OPEN|CMD_EVENT's body, no CRC
+#define CMD_CONFIG              0x04    //tries, interval ms (2) -> status
+#define CONFIG_MAX_MS           16000   //tickCount deadlines are signed 16 bit
+#define CMD_LOG                 0x05    //events only, see log.h
+#define CMD_PROF                0x06    //events only, see prof.h
+#define CMD_REPLY               0x80
+#define CMD_EVENT               0x40    //unsolicited, tag of the command it ends
+
+//CMD_OPEN|CMD_EVENT: tag, 0x41, flags, tries, crc8
+//CMD_STATUS|CMD_EVENT: tag 0, 0x43, the CMD_STATUS data, crc8; once at reset
+//CMD_LOG|CMD_EVENT: tag 0, 0x45, event ID, arg, crc8; SMS Client sends these too
+//CMD_PROF|CMD_EVENT: tag of a CMD_STATUS, 0x46, slot, times..., crc8; PROF builds
+#define FLAG_BUSY               0x01    //an open is in progress
+#define FLAG_ACKED              0x02    //the last one was acked
+
+#define ST_OK                   0
+#define ST_BUSY                 1       //already opening
+#define ST_BAD_CMD              2
+#define ST_BAD_ARGS             3
+
+//frame.c
+extern unsigned char frameBuf[FRAME_MAX];
+extern unsigned char frameDropped;
+unsigned char frameRecv(unsigned char c);
+void frameSend(const unsigned char *buf, unsigned char len);
+unsigned char crc8(unsigned char crc, unsigned char c);
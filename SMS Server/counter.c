@@ -0,0 +1,93 @@
+/******************************************************************************
+ * SMS Client's counter ceiling in info memory, see counter.h
+ ******************************************************************************/
+
+#include  "msp430g2452.h"
+#include "clock.h"
+#include "counter.h"
+#include "info.h"
+
+#define SLOT_ADDR(i)            (COUNTER_INFO_ADDR + 8*(i))
+#define SEGMENT_SLOTS           8       //64 byte segments
+//MCLK/(3*MCLK_MHZ), 333kHz: the timing generator wants 257 to 476kHz
+#define FLASH_FN                (3*MCLK_MHZ - 1)
+
+uint32_t counterCeiling;
+unsigned char counterSlot;                      //next one to write
+unsigned char counterErased;                    //its segment is, when it starts one
+
+//the ceiling in slot i, 0 unless it checks out
+static uint32_t slotRead(unsigned char i)
+{
+    uint32_t v, check;
+    v = (uint32_t)INFO_WORD(SLOT_ADDR(i)) << 16 | INFO_WORD(SLOT_ADDR(i) + 2);
+    check = (uint32_t)INFO_WORD(SLOT_ADDR(i) + 4) << 16 | INFO_WORD(SLOT_ADDR(i) + 6);
+    return v == ~check ? v : 0;
+}
+
+//the highest ceiling written, 0 on a new part; writing goes on after it
+uint32_t counterInit(void)
+{
+    unsigned char i;
+    uint32_t v;
+    counterCeiling = 0;
+    counterSlot = 0;
+    for(i=0; i<COUNTER_SLOTS; i++){
+        v = slotRead(i);
+        if(v > counterCeiling){
+            counterCeiling = v;
+            counterSlot = (i + 1) % COUNTER_SLOTS;
+        }
+    }
+    counterErased = 0;
+    counterErase();
+    return counterCeiling;
+}
+
+//erases the segment counterSlot starts, unless it has been since
+void counterErase(void)
+{
+    unsigned int gie = __get_SR_register() & GIE;
+    if(counterSlot % SEGMENT_SLOTS || counterErased){
+        return;
+    }
+    __disable_interrupt();                      //the vectors are in flash too
+    FCTL2 = FWKEY + FSSEL_1 + FLASH_FN;
+    FCTL3 = FWKEY;                              //unlock
+    FCTL1 = FWKEY + ERASE;
+    INFO_WORD(SLOT_ADDR(counterSlot)) = 0;      //dummy write, erases the segment
+    FCTL3 = FWKEY + LOCK;
+    if(gie){
+        __enable_interrupt();
+    }
+    counterErased = 1;
+}
+
+//call before opening for counter: after a reset, counterInit() is above it
+void counterReserve(uint32_t counter)
+{
+    unsigned int gie = __get_SR_register() & GIE;
+    unsigned int addr = SLOT_ADDR(counterSlot);
+    uint32_t ceiling;
+    if(counter <= counterCeiling){
+        return;
+    }
+    ceiling = counter + COUNTER_AHEAD;
+    counterErase();                             //only if the main loop hasn't yet
+    __disable_interrupt();
+    FCTL2 = FWKEY + FSSEL_1 + FLASH_FN;
+    FCTL3 = FWKEY;
+    FCTL1 = FWKEY + WRT;
+    INFO_WORD(addr) = ceiling >> 16;
+    INFO_WORD(addr + 2) = ceiling;
+    INFO_WORD(addr + 4) = ~ceiling >> 16;       //last, it makes the slot count
+    INFO_WORD(addr + 6) = ~ceiling;
+    FCTL1 = FWKEY;
+    FCTL3 = FWKEY + LOCK;
+    if(gie){
+        __enable_interrupt();
+    }
+    counterCeiling = ceiling;
+    counterSlot = (counterSlot + 1) % COUNTER_SLOTS;
+    counterErased = 0;
+}
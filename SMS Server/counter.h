@@ -0,0 +1,32 @@
+//SMS Client's last counter, kept safe from resets in info memory.
+//
+//The client opens for a counter above the last one it opened for (door.h),
+//which lives in RAM: after a reset every MSG_OPEN ever sent would open the
+//door again. So before it opens for a counter above the ceiling kept in
+//flash, counterReserve() writes a new ceiling COUNTER_AHEAD past it. After a
+//reset the client starts from counterInit(), the last ceiling, and answers
+//the server's next try with MSG_STALE; the server skips past it. A reset
+//costs the server at most COUNTER_AHEAD counters.
+//
+//Ceilings go into 8 byte slots one after another through info memory
+//segments D and C: the counter MSB first, then its complement, so a slot
+//that a reset cut short of either (erased, 0xFF, or half written) doesn't
+//check out and is skipped. A segment is erased before its first slot is
+//written, which leaves the latest ceiling in the other one. Each segment is
+//erased every 16 ceilings, so at the datasheet's minimum 10,000 erases it
+//lasts COUNTER_AHEAD * 16 * 10,000 opens, 5 million.
+//
+//An erase holds the CPU for ~15ms, interrupts and all, so it isn't done on
+//the way to opening the door: counterInit() and counterErase(), from the
+//main loop while nothing else is going on, get the next segment ready. A
+//slot write takes ~0.4ms.
+
+#include <stdint.h>
+
+#define COUNTER_INFO_ADDR       0x1000  //segments D and C, 128 bytes
+#define COUNTER_SLOTS           16
+#define COUNTER_AHEAD           32
+
+uint32_t counterInit(void);
+void counterReserve(uint32_t counter);
+void counterErase(void);
@@ -0,0 +1,84 @@
+/******************************************************************************
+ * Door open exchange: building packets in RF_24G_TxBuffer and checking the
+ * ones getBuffer() hands over
+ ******************************************************************************/
+
+#include  "msp430g2452.h"
+#include "rf24g_2.h"
+#include "door.h"
+#include "mac.h"
+#include "info.h"
+
+#if RF_24G_PAYLOADSIZE < MSG_MAC + MAC_LEN
+#error "RF_24G_PAYLOADSIZE is too small for a door message"
+#endif
+#if MSG_MAC != 6 || MAC_LEN != 4
+#error "msgMac() puts the 6 bytes before MSG_MAC and the node in one block"
+#endif
+
+#define DOOR_KEY                ((const uint32_t *)&INFO_BYTE(INFO_KEY_ADDR))
+
+const uint8_t hopChannels[HOP_COUNT] = HOP_CHANNELS;
+
+//4 bytes at p, MSB first
+static uint32_t get32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (unsigned int)p[2] << 8 | p[3];
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+//the MAC of the 6 bytes before MSG_MAC and node: the block is those 7 bytes
+//zero padded, straight from the packet, and the MAC its x word
+static uint32_t msgMac(const uint8_t *pkt, uint8_t node)
+{
+    uint32_t x = get32(pkt);
+    uint32_t y = (uint32_t)((unsigned int)pkt[4] << 8 | pkt[5]) << 16 | (unsigned int)node << 8;
+    speck64(DOOR_KEY, &x, &y);
+    return x;
+}
+
+//fills RF_24G_TxBuffer for putBuffer(), node is the door's
+void makeMsg(uint8_t type, uint32_t counter, uint8_t hop, uint8_t node)
+{
+    RF_24G_TxBuffer[MSG_TYPE] = type;
+    put32(&RF_24G_TxBuffer[MSG_COUNTER], counter);
+    RF_24G_TxBuffer[MSG_HOP] = hop;
+    put32(&RF_24G_TxBuffer[MSG_MAC], msgMac(RF_24G_TxBuffer, node));
+}
+
+//type of the packet getBuffer() handed over, 0 if its MAC is wrong for door
+//node. Both halves of the difference are looked at whatever the first one
+//holds, so the time it takes says nothing about how close a forged MAC is
+uint8_t msgType(const uint8_t *pkt, uint8_t node)
+{
+    uint32_t diff = msgMac(pkt, node) ^ get32(&pkt[MSG_MAC]);
+    return pkt[MSG_TYPE] & -(uint8_t)(((unsigned int)(diff >> 16) | (unsigned int)diff) == 0);
+}
+
+uint32_t msgCounter(const uint8_t *pkt)
+{
+    return get32(&pkt[MSG_COUNTER]);
+}
+
+//always one in HOP_CHANNELS
+uint8_t msgHop(const uint8_t *pkt)
+{
+    return pkt[MSG_HOP] % HOP_COUNT;
+}
+
+//no key programmed at INFO_KEY_ADDR, every byte of it still 0xFF
+uint8_t keyErased(void)
+{
+    uint8_t i, all = 0xFF;
+    for(i=0; i<16; i++){
+        all &= INFO_BYTE(INFO_KEY_ADDR + i);
+    }
+    return all == 0xFF;
+}
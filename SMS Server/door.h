@@ -0,0 +1,73 @@
+//Door open exchange over the RF-24G, shared by SMS Server and SMS Client.
+//
+//Every exchange has a new 32 bit counter. The server sends MSG_OPEN with it
+//every OPEN_INTERVAL_US until the client answers with MSG_ACK carrying the
+//same counter, or it has tried OPEN_COUNT times. The client opens for a
+//counter above the last one it opened for and acks it, repeats included,
+//since its ack may have been the packet that was lost. A lower counter gets
+//MSG_STALE with the client's last counter, so a server that was reset can
+//catch up. A client that was reset starts from a ceiling over its last
+//counter kept in info memory (counter.h), and the server catches up to that
+//the same way. Every message carries a MAC over type, counter and the
+//door's node ID, so what is meant for one door is no good to another.
+//
+//Each door receives on its own node address and the server on SERVER_NODE;
+//RF_24G_Config() and RF_24G_TxNode set them.
+//
+//Everyone shares the HOP_CHANNELS sequence. The server has a home channel in
+//it and sends an exchange's tries there. Once HOP_MISSES tries in a row there
+//have gone unanswered, every HOP_SWEEP-th one goes round the other channels,
+//so a door left on one still hears from it. Every message carries a channel
+//index in MSG_HOP and a door moves there once it has answered.
+//
+//The server counts tries and answers on each channel while it is home, over
+//about the last HOP_WINDOW tries. A move strands every door that does not
+//hear it go out, so it only looks at one after those HOP_MISSES misses, and
+//when home answers fewer than one try in HOP_POOR. It moves to the next
+//channel in the sequence only if that has had fewer than HOP_MEASURED tries
+//as home, or twice the answers per try and at least 2 of them. When every
+//channel loses alike, home stays put once each has been tried. The move goes
+//out in MSG_HOP on the old home, where the doors are, and the server follows
+//once a door has answered it. Until then every other try goes to the new
+//channel, for a door that moved but whose answer was lost.
+
+#include <stdint.h>
+
+#define MSG_TYPE                0       //payload byte offsets
+#define MSG_COUNTER             1       //4 bytes, MSB first
+#define MSG_HOP                 5       //index into HOP_CHANNELS to listen on next
+#define MSG_MAC                 6       //MAC_LEN bytes over the 6 before it and the node
+
+#define MSG_OPEN                'O'
+#define MSG_ACK                 'A'
+#define MSG_STALE               'S'
+
+#define SERVER_NODE             0x42    //ADDR1_0, the address the link always had
+
+//A door's node ID can be programmed into info memory segment B at install, so
+//one SMS Client image serves every door; it uses CLIENT_NODE while erased.
+#define INFO_NODE_ADDR          0x1080
+
+//The key the server and its doors share is programmed into segment B too, a
+//new one for every installation: 4 words, least significant byte first, as
+//speck64() takes them. Neither image runs while it is erased, see keyErased().
+#define INFO_KEY_ADDR           0x1090
+
+//RF channels (2400MHz + n MHz) in the gaps around Wi-Fi channels 1, 6 and 11
+#ifndef HOP_CHANNELS
+#define HOP_CHANNELS            { 25, 49, 75 }
+#define HOP_COUNT               3
+#endif
+#define HOP_SWEEP               4       //power of two
+#define HOP_MISSES              8
+#define HOP_WINDOW              32      //tries per channel before the counts halve
+#define HOP_MEASURED            8
+#define HOP_POOR                4
+
+extern const uint8_t hopChannels[HOP_COUNT];
+
+void makeMsg(uint8_t type, uint32_t counter, uint8_t hop, uint8_t node);
+uint8_t msgType(const uint8_t *pkt, uint8_t node);
+uint32_t msgCounter(const uint8_t *pkt);
+uint8_t msgHop(const uint8_t *pkt);
+uint8_t keyErased(void);
@@ -0,0 +1,91 @@
+/******************************************************************************
+ * SLIP framing with a CRC-8 for the command protocol in cmd.h
+ *
+ * frameRecv() is fed one received byte at a time and decodes in place, so
+ * the only buffer is frameBuf. The CRC runs along as the bytes come in; with
+ * no final XOR it comes out 0 over a body and its own CRC, so that byte is
+ * never stored. frameSend() encodes straight into putc().
+ ******************************************************************************/
+
+#include "cmd.h"
+
+void putc(const char c);
+
+unsigned char frameBuf[FRAME_MAX];
+unsigned char frameDropped;                     //bad CRC or too long
+unsigned char frameLen;
+unsigned char frameEsc;
+unsigned char frameCrc;                         //over frameLen bytes so far
+
+unsigned char crc8(unsigned char crc, unsigned char c)
+{
+    unsigned char i;
+    crc ^= c;
+    for(i=0; i<8; i++){
+        crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+}
+
+//returns the body length (CRC checked and dropped) once c completes a good
+//frame, 0 otherwise
+unsigned char frameRecv(unsigned char c)
+{
+    unsigned char n;
+    if(c == SLIP_END){
+        n = frameLen;
+        frameLen = 0;
+        frameEsc = 0;
+        if(n == 0){
+            return 0;                           //back to back ENDs
+        }
+        if(n > FRAME_MAX+1 || n < 3 || frameCrc){   //tag, command, CRC at least
+            frameCrc = 0;
+            frameDropped++;
+            return 0;
+        }
+        return n-1;
+    }
+    if(c == SLIP_ESC){
+        frameEsc = 1;
+        return 0;
+    }
+    if(frameEsc){
+        frameEsc = 0;
+        c = (c == SLIP_ESC_END) ? SLIP_END : (c == SLIP_ESC_ESC) ? SLIP_ESC : c;
+    }
+    if(frameLen < FRAME_MAX){
+        frameBuf[frameLen] = c;
+    }
+    frameCrc = crc8(frameCrc, c);
+    if(frameLen < 255){
+        frameLen++;                             //too long, dropped at the END
+    }
+    return 0;
+}
+
+static void slipPut(unsigned char c)
+{
+    if(c == SLIP_END){
+        putc(SLIP_ESC);
+        putc(SLIP_ESC_END);
+    }else if(c == SLIP_ESC){
+        putc(SLIP_ESC);
+        putc(SLIP_ESC_ESC);
+    }else{
+        putc(c);
+    }
+}
+
+//sends buf as one frame with its CRC
+void frameSend(const unsigned char *buf, unsigned char len)
+{
+    unsigned char i, crc = 0;
+    putc(SLIP_END);
+    for(i=0; i<len; i++){
+        crc = crc8(crc, buf[i]);
+        slipPut(buf[i]);
+    }
+    slipPut(crc);
+    putc(SLIP_END);
+}
@@ -0,0 +1,11 @@
+//Info memory (0x1000-0x10FF), read and written by address: the door's node ID
+//(door.h) and the counter ceiling (counter.h). A write only programs flash
+//with the controller set up for it, see counter.c. The simulator's stand-in
+//msp430g2452.h defines these first, into the simulated part's info memory.
+
+#ifndef INFO_BYTE
+#define INFO_BYTE(addr)         (*(volatile unsigned char *)(addr))
+#endif
+#ifndef INFO_WORD
+#define INFO_WORD(addr)         (*(volatile unsigned int *)(addr))
+#endif
@@ -0,0 +1,63 @@
+/******************************************************************************
+ * Event log, see log.h
+ *
+ * logEvent() may be called from interrupts: it only takes a slot in the ring
+ * (or counts the event lost when the ring is full). logFlush() runs in the
+ * main loop and frames as many events as the UART queue has room for.
+ ******************************************************************************/
+
+#include  "msp430g2452.h"
+#include "cmd.h"
+#include "log.h"
+
+#define LOG_BUF_MASK            (LOG_BUF_SIZE-1)
+
+unsigned char logId[LOG_BUF_SIZE];
+unsigned int logArg[LOG_BUF_SIZE];
+volatile unsigned char logHead;                 //free running, written by logEvent
+volatile unsigned char logTail;                 //free running, written by logFlush
+volatile unsigned char logLost;                 //full when they came, up to 255
+
+void logEvent(unsigned char id, unsigned int arg)
+{
+    unsigned int gie = __get_SR_register() & GIE;
+    __disable_interrupt();
+    if((unsigned char)(logHead - logTail) < LOG_BUF_SIZE){
+        logId[logHead & LOG_BUF_MASK] = id;
+        logArg[logHead & LOG_BUF_MASK] = arg;
+        logHead++;
+    }else if(logLost < 255){
+        logLost++;
+    }
+    if(gie){
+        __enable_interrupt();
+    }
+}
+
+//room: bytes free in the UART queue, so frameSend() never has to wait
+void logFlush(unsigned char room)
+{
+    unsigned char buf[5];
+    unsigned int arg;
+    buf[0] = 0;                                 //tag 0, nobody asked
+    buf[1] = CMD_LOG | CMD_EVENT;
+    while(room >= LOG_FRAME_MAX){
+        if(logTail != logHead){
+            buf[2] = logId[logTail & LOG_BUF_MASK];
+            arg = logArg[logTail & LOG_BUF_MASK];
+            logTail++;
+        }else if(logLost){
+            __disable_interrupt();
+            buf[2] = EV_LOST;
+            arg = logLost;                      //after the ones that made it
+            logLost = 0;
+            __enable_interrupt();
+        }else{
+            return;
+        }
+        buf[3] = arg >> 8;
+        buf[4] = arg;
+        frameSend(buf, 5);
+        room -= LOG_FRAME_MAX;
+    }
+}
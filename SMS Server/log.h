@@ -0,0 +1,46 @@
+//Event log, shared by SMS Server and SMS Client.
+//
+//LOG(EV_x, arg) records an event ID and a 16 bit word into a RAM ring: a
+//handful of cycles, interrupts included, and never a wait on the UART.
+//logFlush() sends what the ring holds from the main loop when the UART has
+//room, one frame per event (cmd.h):
+//      tag 0, CMD_LOG|CMD_EVENT, event ID, arg high, arg low, crc8
+//The text only lives here, for the host (smssim) to print the events with;
+//the firmware just has the IDs. Events above LOG_LEVEL compile to nothing.
+
+#define LOG_OFF                 0
+#define LOG_ERR                 1
+#define LOG_INFO                2
+#define LOG_DEBUG               3
+#ifndef LOG_LEVEL
+#define LOG_LEVEL               LOG_INFO
+#endif
+
+//ID, level, text; %u is the argument, counters give their low 16 bits.
+//Add to the end only, hosts go by ID.
+#define LOG_EVENTS(X) \
+    X(EV_LOST,      LOG_ERR,    "%u events lost, the UART was behind") \
+    X(EV_RESET,     LOG_INFO,   "Reset, node %u") \
+    X(EV_WAITING,   LOG_DEBUG,  "Waiting") \
+    X(EV_SIGNAL,    LOG_DEBUG,  "Signal") \
+    X(EV_BAD,       LOG_INFO,   "Bad, type %u") \
+    X(EV_CORRECT,   LOG_INFO,   "Correct, counter %u") \
+    X(EV_REPEAT,    LOG_INFO,   "Repeat, counter %u") \
+    X(EV_STALE,     LOG_INFO,   "Stale, counter %u") \
+    X(EV_CLOSED,    LOG_INFO,   "Closed") \
+    X(EV_BROADCAST, LOG_DEBUG,  "Broadcast, type %u") \
+    X(EV_HOME,      LOG_INFO,   "Home channel %u") \
+    X(EV_OVERRUN,   LOG_ERR,    "%u UART bytes dropped")
+
+#define LOG_ID(id, level, text)     id,
+#define LOG_LEVEL_OF(id, level, text)   id##_LEVEL = level,
+enum { LOG_EVENTS(LOG_ID) EV_COUNT };
+enum { LOG_EVENTS(LOG_LEVEL_OF) };
+
+#define LOG(id, arg)            do{ if(id##_LEVEL <= LOG_LEVEL) logEvent(id, arg); }while(0)
+
+#define LOG_BUF_SIZE            4       //events, power of two, <=128
+#define LOG_FRAME_MAX           11      //SLIP ENDs and a frame, arg and CRC escaped
+
+void logEvent(unsigned char id, unsigned int arg);
+void logFlush(unsigned char room);
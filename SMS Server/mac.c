@@ -0,0 +1,37 @@
+/******************************************************************************
+ * Speck64/128 MAC
+ *
+ * Speck was picked over XTEA for the MSP430: a round is one 32 bit add, two
+ * xors, a rotate by 8 (byte swaps) and a rotate by 3, where XTEA needs shifts
+ * by 4 and 5 plus key lookups. The round keys are made on the fly, not kept
+ * in RAM: the block and key words want every register, and the stack takes
+ * the rest (make target in SMS Sim has the figure).
+ *
+ * A single block cipher call is a sound MAC for fixed length messages that
+ * fit one block, which is all the door messages are.
+ ******************************************************************************/
+
+#include "mac.h"
+
+#define ROR(x, r)   (((x) >> (r)) | ((x) << (32-(r))))
+#define ROL(x, r)   (((x) << (r)) | ((x) >> (32-(r))))
+
+//encrypts the block (x, y) in place
+void speck64(const uint32_t key[4], uint32_t *x, uint32_t *y)
+{
+    uint32_t a = key[0], b = key[1], c = key[2], d = key[3], t;
+    uint32_t bx = *x, by = *y;
+    uint8_t i;
+    for(i=0; i<SPECK_ROUNDS; i++){
+        bx = (ROR(bx, 8) + by) ^ a;
+        by = ROL(by, 3) ^ bx;
+        b = (ROR(b, 8) + a) ^ i;
+        a = ROL(a, 3) ^ b;
+        t = b;                          //next key word comes from c
+        b = c;
+        c = d;
+        d = t;
+    }
+    *x = bx;
+    *y = by;
+}
@@ -0,0 +1,11 @@
+//Message authentication for the door open exchange: Speck64/128 over one
+//8 byte block, truncated to MAC_LEN bytes, the x word. door.c lays the
+//message out in the block. Plain C with no registers, so the simulator's
+//stub peers build with it too.
+
+#include <stdint.h>
+
+#define MAC_LEN                 4       //bytes of the tag that go on the air
+#define SPECK_ROUNDS            27
+
+void speck64(const uint32_t key[4], uint32_t *x, uint32_t *y);
@@ -11,11 +11,17 @@
  *      if timeout, send message to cpu resend message to rf
  ******************************************************************************/
 
-#include  "msp430x20x2.h"
+#include  "msp430g2452.h"
 #include "rf24g_2.h"
+#include "clock.h"
+#include "timer.h"
+#include "door.h"
+#include "cmd.h"
+#include "log.h"
+#include "prof.h"
 
-#define OPEN_COUNT (24*5)
-#define MAGIC_CHAR 'O'
+#define OPEN_COUNT (24*5)                  //tries before giving up without an ack
+#define OPEN_INTERVAL_US (1000000/24)      //24 tries a second for 5 seconds
 
 #define     false               0
 #define     true                1
@@ -37,9 +43,7 @@
 #define     TXD                 BIT1                      // TXD on P1.1
 #define     RXD                 BIT2                      // RXD on P1.2
 
-//   Conditions for 9600/4=2400 Baud SW UART, SMCLK = 1MHz
-#define     Bitime_5              0x05*4                      // ~ 0.5 bit length + small adjustment
-#define     Bitime                13*4//0x0D    
+//   Bitime and Bitime_5 for BAUD come from the clock profile, clock.h
 
 #define     TEST 0b01010101
 
@@ -49,24 +53,76 @@ void InitializeButton(void);
 void InitializeSerial(void); 
 void InitializeClocks(void);
 void puts(const char * s);
+unsigned char txFree(void);
 void putc(const char c);
 void putc_i(const char c);
 int getc(char *c);
+int read(char *buf, int len);
 void EchoTest();
 void RFTest();
 void OpenDoor();
+void openStep(void);
 void mainLoop();
+void command(unsigned char len);
+void openEvent(void);
+void resetEvent(void);
+unsigned char status(unsigned char *buf);
 void ledOn();
 void ledOff();
 
 
 //private globals and functions
 unsigned int TxData;
-unsigned int RxData;
-char BitCnt;
-volatile int recvFlag=0;
+unsigned char RxData;
+char TxBitCnt;
+char RxBitCnt;
+
+//receive ring buffer, filled by Timer_A at the end of each frame. mainLoop
+//only takes a command out of it once its reply fits the transmit queue, so
+//it holds the next command in full while a reply goes out
+#define     RX_BUF_SIZE         16                        // power of two, <=128, FRAME_OUT(FRAME_MAX)
+#define     RX_BUF_MASK         (RX_BUF_SIZE-1)
+unsigned char rxBuf[RX_BUF_SIZE];
+volatile unsigned char rxHead;                            // free running, written by ISR
+volatile unsigned char rxTail;                            // free running, written by getc
+volatile unsigned char rxOverrun;                         // bytes dropped, buffer full
+
+//transmit queue, drained by Timer_A one frame after another. mainLoop only
+//sends a reply, an event or the log once it fits, so it never waits on the
+//UART; the profile table (PROF) does, between exchanges
+#define     TX_BUF_SIZE         (FRAME_OUT(REPLY_MAX)+1)
+unsigned char txBuf[TX_BUF_SIZE];                         // one slot kept empty
+volatile unsigned char txHead;                            // next to fill, written by putc
+volatile unsigned char txTail;                            // next to send, written by TX_Next
+
+//door open exchange, run from mainLoop
+unsigned char openBusy;                                   // until acked or out of tries
+unsigned char openAcked;
+unsigned char openLeft;                                   // tries still to send
+unsigned char openSent;                                   // and sent so far
+unsigned int openNext;                                    // tickCount of the next one
+unsigned int openInterval;                                // ticks between tries, CMD_CONFIG
+uint32_t openCounter;                                     // rolling code of this exchange
+unsigned char openNode;                                   // door it is for
+unsigned char openHome;                                   // HOP_CHANNELS index doors listen on
+unsigned char openMove;                                   // and MSG_HOP sends them to, see door.h
+unsigned char openHop;                                    // the last try went out on
+unsigned char homeMisses;                                 // tries on openHome since an answer
+unsigned char hopTries[HOP_COUNT];                        // tries on each channel while home
+unsigned char hopAcks[HOP_COUNT];                         // and answers to them, HOP_WINDOW
+unsigned char openBuilt;                                  // RF_24G_TxBuffer has the MSG_OPEN to send
+
+//command protocol, see cmd.h
+unsigned char opening;                                    // CMD_OPEN|CMD_EVENT still to send
+unsigned char openTag;                                    // tag of the CMD_OPEN
+unsigned char openTries;                                  // per exchange, CMD_CONFIG
+#ifdef PROF
+unsigned char profTag;                                    // CMD_STATUS to send the table after
+unsigned char profWanted;
+#endif
 
 void TX_Byte(void);
+void TX_Next(void);
 void RX_Ready(void);
 
 
@@ -75,22 +131,22 @@ void RX_Ready(void);
  ******************************************************************************/
 void main(void)
 {
-    unsigned char i;
     WDTCTL = WDTPW + WDTHOLD;                 // Stop watchdog timer
     InitializeClocks();
+    if(keyErased()){
+        __bis_SR_register(LPM4_bits);         //no door key to open with, see door.h
+    }
     InitializeButton();
     InitializeLeds();
     InitializeSerial();
+    InitializeTimers();
     RF_24G_init();
-    RF_24G_Config();
+    RF_24G_Config(SERVER_NODE);
+    openTries = OPEN_COUNT;
+    openInterval = US_TICKS(OPEN_INTERVAL_US);
     __enable_interrupt();                     
 
-
-    //initialize super special message
-    for(i=0; i<RF_24G_PAYLOADSIZE; i++){
-        RF_24G_Buffer[i] = RF_24G_PAYLOADSIZE-i;
-    }
-    puts("Server.\r\n");
+    resetEvent();
 
     //EchoTest(); //doesn't return
     //RFTest();//doesn't return
@@ -127,9 +183,9 @@ void RFTest()
 {
     uint8_t i;
     RF_24G_SetTx() ;
-    //strcpy(RF_24G_Buffer, "abcde!");
+    //strcpy(RF_24G_TxBuffer, "abcde!");
     for(i=0; i<RF_24G_PAYLOADSIZE; i++){
-        RF_24G_Buffer[i] = RF_24G_PAYLOADSIZE-i;
+        RF_24G_TxBuffer[i] = RF_24G_PAYLOADSIZE-i;
     }
     while(1){
         putBuffer();
@@ -137,30 +193,210 @@ void RFTest()
     }
 }
 
+//Everything runs from here, interrupts only move bits and count ticks: the
+//stack has to hold the deepest of these and one interrupt on top, no more
 void mainLoop()
 {
     char inchar;
-    if(getc(&inchar)){
-        putc(inchar);   //echo
-        puts(": ");
-        putc_i(inchar);
-        puts("\r\n");
-        if(inchar==MAGIC_CHAR){
-            puts("Opening \r\n");
+    unsigned char len;
+    if(openBusy){
+        openStep();
+    }
+    if(opening && !openBusy && txFree() >= FRAME_OUT(OPEN_EVENT_LEN)){
+        openEvent();
+    }
+#ifdef PROF
+    if(profWanted && !openBusy){
+        profWanted = 0;
+        profDump(profTag);                    //waits on the UART, not on a try
+    }
+#endif
+    while(txFree() >= FRAME_OUT(REPLY_MAX) && getc(&inchar)){
+        len = frameRecv(inchar);
+        if(len){
+            command(len);
+        }
+    }
+    logFlush(txFree());                       //what room the replies leave
+}
+
+//runs the command in frameBuf and replies to it
+void command(unsigned char len)
+{
+    unsigned char buf[REPLY_MAX];             //status has more to say than a command
+    unsigned char n = 3;
+    unsigned int ms;
+    buf[0] = frameBuf[0];
+    buf[1] = frameBuf[1] | CMD_REPLY;
+    buf[2] = ST_OK;
+    switch(frameBuf[1]){
+    case CMD_OPEN:
+        if(len != 3 || frameBuf[2] == SERVER_NODE){
+            buf[2] = ST_BAD_ARGS;
+        }else if(opening){
+            buf[2] = ST_BUSY;
+        }else{
+            openTag = frameBuf[0];
+            openNode = frameBuf[2];
             ledOn();
             OpenDoor();
-            ledOff();
-            puts("Done\r\n");
+            opening=1;
+        }
+        break;
+    case CMD_CLOSE:
+        openBusy = 0;                         //mainLoop sends the event, not acked
+        break;
+    case CMD_STATUS:
+        n += status(buf + 3);
+        break;
+    case CMD_CONFIG:
+        ms = (unsigned int)frameBuf[3] << 8 | frameBuf[4];
+        if(len != 5 || !frameBuf[2] || !ms || ms > CONFIG_MAX_MS){
+            buf[2] = ST_BAD_ARGS;
+        }else{
+            openTries = frameBuf[2];
+            openInterval = US_TICKS(ms * 1000UL);
         }
+        break;
+    default:
+        buf[2] = ST_BAD_CMD;
+        break;
     }
+    frameSend(buf, n);
+#ifdef PROF
+    if(frameBuf[1] == CMD_STATUS){
+        profTag = buf[0];                     //after the reply, see mainLoop
+        profWanted = 1;
+    }
+#endif
+}
+
+//CMD_OPEN|CMD_EVENT for the exchange that just ended
+void openEvent(void)
+{
+    unsigned char buf[OPEN_EVENT_LEN];
+    ledOff();
+    buf[0] = openTag;
+    buf[1] = CMD_OPEN | CMD_EVENT;
+    buf[2] = openAcked ? FLAG_ACKED : 0;
+    buf[3] = openSent;
+    frameSend(buf, OPEN_EVENT_LEN);
+    opening=0;
 }
 
+//tag 0, status event: we were reset. Not in main(), where the buffer would
+//stay on the stack under everything mainLoop does
+void resetEvent(void)
+{
+    unsigned char buf[2 + STATUS_LEN];
+    buf[0] = 0;
+    buf[1] = CMD_STATUS | CMD_EVENT;
+    frameSend(buf, 2 + status(buf + 2));
+}
+
+//fills in the CMD_STATUS data, returns its length
+unsigned char status(unsigned char *buf)
+{
+    buf[0] = (openBusy ? FLAG_BUSY : 0) | (openAcked ? FLAG_ACKED : 0);
+    buf[1] = openSent;
+    buf[2] = openCounter >> 24;
+    buf[3] = openCounter >> 16;
+    buf[4] = openCounter >> 8;
+    buf[5] = openCounter;
+    buf[6] = frameDropped;
+    buf[7] = hopChannels[openHome];
+    return STATUS_LEN;
+}
+
+//starts the door-open exchange and returns: mainLoop sends MSG_OPEN up to
+//openTries times, openInterval ticks apart, and openBusy drops when it is over
 void OpenDoor()
 {
-    int timer=0;
-    for(timer=0; timer<OPEN_COUNT; timer++){
-        puts("Opening   ");
+    openCounter++;
+    openBuilt = 0;
+    openAcked = 0;
+    openNext = tickCount;                   //first one right away
+    openLeft = openTries;
+    openSent = 0;
+    openBusy = 1;
+}
+
+//mainLoop's part of an exchange. The radio stays in RX between tries, a
+//packet waiting on DR1 is read here and ends the exchange if it is our ack.
+//Tries go to openHome, and round HOP_CHANNELS now and then, see door.h. The
+//MSG_OPEN is only built again, MAC and all, when its counter or openMove changes.
+void openStep(void)
+{
+    uint8_t type, next;
+    uint8_t *pkt;
+    if(hasData()){
+        pkt = getBuffer();
+        type = msgType(pkt, openNode);
+        if(type == MSG_ACK || type == MSG_STALE){
+            if(openHop == openHome){
+                homeMisses = 0;             //the home channel gets through
+                hopAcks[openHome]++;
+            }
+            if(openMove != openHome){
+                openHome = openMove;        //a door has moved, the rest follow
+                LOG(EV_HOME, hopChannels[openHome]);
+                homeMisses = 0;
+            }
+        }
+        if(type == MSG_ACK && msgCounter(pkt) == openCounter){
+            openAcked = 1;
+            openBusy = 0;
+            return;
+        }
+        if(type == MSG_STALE && msgCounter(pkt) >= openCounter){
+            LOG(EV_STALE, msgCounter(pkt));
+            openCounter = msgCounter(pkt) + 1;  //we were reset, skip past the client
+            openBuilt = 0;
+            openNext = tickCount;               //and try again right away
+        }
+    }
+    if((int)(tickCount - openNext) >= 0){
+        if(!openLeft){
+            openBusy = 0;                   //last try had its interval to be acked
+            return;
+        }
+        openNext = tickCount + openInterval;    //no catching up after a wait on the UART
+        if(homeMisses >= HOP_MISSES && openMove == openHome
+                && hopAcks[openHome] * HOP_POOR < hopTries[openHome]){
+            next = (openHome + 1) % HOP_COUNT;      //next in the sequence
+            if(hopTries[next] < HOP_MEASURED
+                    || (hopAcks[next] >= 2 && (unsigned int)hopAcks[next] * hopTries[openHome]
+                        > 2 * (unsigned int)hopAcks[openHome] * hopTries[next])){
+                openMove = next;            //untried, or twice the answers per try
+                openBuilt = 0;
+            }
+        }
+        openHop = openHome;
+        if(openMove != openHome && openSent % 2){
+            openHop = openMove;             //a door may have moved but its answer got lost
+        }else if(openSent % HOP_SWEEP == 0 && homeMisses >= HOP_MISSES){
+            openHop = (openHome + openSent / HOP_SWEEP) % HOP_COUNT;
+        }
+        if(openHop == openHome){
+            if(homeMisses != 255){
+                homeMisses++;
+            }
+            if(++hopTries[openHome] == HOP_WINDOW){
+                hopTries[openHome] /= 2;    //forget the old half
+                hopAcks[openHome] /= 2;
+            }
+        }
+        RF_24G_SetChannel(hopChannels[openHop]);
+        RF_24G_SetTx();
+        if(!openBuilt){
+            makeMsg(MSG_OPEN, openCounter, openMove, openNode);
+            openBuilt = 1;
+        }
+        RF_24G_TxNode = openNode;
         putBuffer();
+        RF_24G_SetRx();
+        openLeft--;
+        openSent++;
     }
 }
 
@@ -178,9 +414,12 @@ void ledOn()
 void InitializeClocks(void)
 {
 
-    BCSCTL1 = CALBC1_1MHZ;                     // Set range
-    DCOCTL = CALDCO_1MHZ;
-    BCSCTL2 &= ~(DIVS_3);                      // SMCLK = DCO / 8 = 1MHz  
+    if(CALBC1_MCLK == 0xFF){
+        while(1);                              // Calibration erased, see clock.h
+    }
+    BCSCTL1 = CALBC1_MCLK;                     // Set range
+    DCOCTL = CALDCO_MCLK;
+    BCSCTL2 &= ~(DIVS_3);                      // SMCLK = DCO = MCLK_MHZ
 }
 
 void InitializeButton(void)              
@@ -204,15 +443,15 @@ void InitializeSerial(void)
 {
     CCTL0 = OUT;                               // TXD Idle as Mark
     //TACTL = TASSEL_1 + MC_2;                 // ACLK, continuous mode --from example file
-    TACTL = TASSEL_2 + MC_2 + ID_3;            // SMCLK/8, continuous mode --from example project that shiped w/ board
-    //P1SEL |= TXD + RXD;                      //
-    P1SEL |= TXD ;                        
+    TACTL = TASSEL_2 + MC_2 + ID_3;            // SMCLK/8 = TACLK_HZ, continuous mode --from example project that shiped w/ board
+    P1SEL |= TXD + RXD;                        // TA0.0 out, CCI1A in
     P1DIR |= TXD;                              // TXD is output
     P1DIR &= ~RXD;                             // RXD is input
-    P1IES=RXD;  //Falling edge
 
-    recvFlag=0;
+    rxHead=rxTail=0;
+    txHead=txTail=0;
     RX_Ready();
+    rxOverrun=0;
 }
 
 void puts(const char * s)
@@ -223,11 +462,31 @@ void puts(const char * s)
     }
 }
 
+//bytes putc() can queue without waiting
+unsigned char txFree(void)
+{
+    unsigned char n = txTail;
+    if(n <= txHead){
+        n += TX_BUF_SIZE;
+    }
+    return n - txHead - 1;
+}
+
+//queues c for Timer_A to send, only waits when the queue is full
 void putc(const char c)
 {
-    TxData = c;
-    TX_Byte();  //blocks till completion
-    RX_Ready();
+    unsigned char next = txHead + 1;
+    if(next == TX_BUF_SIZE){
+        next = 0;
+    }
+    while(next == txTail && (CCTL0 & CCIE));   //Timer_A makes room one frame at a time
+    txBuf[txHead] = c;
+    __disable_interrupt();
+    txHead = next;
+    if(!(CCTL0 & CCIE)){
+        TX_Byte();                          //CCR0 is idle, start it up
+    }
+    __enable_interrupt();
 }
 
 /*******************************************************************************
@@ -247,108 +506,121 @@ void putc_i(const char c)
 //returns true if a character was received
 int getc(char *c)
 {
-    if(recvFlag){
-        *c = RxData;
-        recvFlag=false;
+    if(rxHead!=rxTail){
+        *c = rxBuf[rxTail & RX_BUF_MASK];
+        rxTail++;
         return true;
     }else{
         return false;
     }
 }
 
-// Function Transmits Character from TxData Buffer
+//copies up to len received characters into buf, returns how many
+int read(char *buf, int len)
+{
+    int n=0;
+    while(n<len && getc(&buf[n])){
+        n++;
+    }
+    return n;
+}
+
+// Function Starts Transmitting the Transmit Queue, CCR0 must be idle
 void TX_Byte (void)
 {
-    BitCnt = 0xA;                             // Load Bit counter, 8data + ST/SP
+    PROF_START(t0);
+    TX_Next();
     while (CCR0 != TAR)                       // Prevent async capture
         CCR0 = TAR;                           // Current state of TA counter
     CCR0 += Bitime;                           // Some time till first bit
+    CCTL0 =  OUTMOD0 + CCIE;                  // TXD = mark = idle
+    PROF_END(PROF_TX_BYTE, t0);
+}
+
+// Function Loads the Next Queued Character into TxData
+void TX_Next (void)
+{
+    TxData = txBuf[txTail];
+    if(++txTail == TX_BUF_SIZE){
+        txTail = 0;
+    }
+    TxBitCnt = 0xA;                           // Load Bit counter, 8data + ST/SP
     TxData |= 0x100;                          // Add mark stop bit 
     TxData = TxData << 1;                     // Add space start bit
-    CCTL0 =  CCIS0 + OUTMOD0 + CCIE;          // TXD = mark = idle
-    while ( CCTL0 & CCIE );                   // Wait for TX completion
 }
 
 
 // Function Readies UART to Receive Character into RxData Buffer
 void RX_Ready (void)
 {
-    BitCnt = 0;                             // Load Bit counter
-    //CCTL0 = SCS + OUTMOD0 + CM1 + CAP + CCIE;   // Sync, Neg Edge, Cap
-    P1IE = RXD;
-    P1IFG &= ~RXD;  //setting IE may trigger IFG, so clear it
+    RxBitCnt = 0;                           // Load Bit counter
+    P1SEL |= RXD;                           // RXD is CCI1A
+    CCTL1 = SCS + CM1 + CAP + CCIE;         // Sync, Neg Edge, Cap
 }
 
-//called from interrupt
-void RecvMode(void)
+// Timer A0 interrupt service routine, CCR0 transmits. CCR1 receives at the
+// same time, in Timer_A1
+#pragma vector=TIMER0_A0_VECTOR
+__interrupt void Timer_A (void)
 {
-    //CCTL0 &= ~ CAP;                         // Switch from capture to compare mode
-    CCTL0 = OUTMOD0 + CCIE;   // Sync, Neg Edge, Cap
-    CCR0 = Bitime+TAR;
-}
+    PROF_START(t0);
+    CCR0 += Bitime;                                 // Add Offset to CCR0
 
-// Port 1 interrupt service routine
-#pragma vector=PORT1_VECTOR
-__interrupt void Port_1(void)
-{
-    if(P1IFG & RXD){
-        //got a start bit
-        //RxData is now corrupted, so clear flag
-        recvFlag=0;
-        P1IE &= ~RXD;                           //Disable interrupt
-        P1IFG &= ~RXD;                          // P1.4 IFG cleared
-        //enable timer interrupt to receive remaining bits
-        CCTL0 = OUTMOD0 + CCIE;   // Sync, Neg Edge, Cap
-        //Sample the next bit at TAR + Bittime
-        CCR0 = Bitime+TAR;
+    if ( TxBitCnt == 0 && txHead != txTail)
+        TX_Next();                                  // Stop bit is out, start the next one
+    if ( TxBitCnt == 0)
+    {
+        CCTL0 &= ~ CCIE;                            // Queue empty, disable interrupt
+        _BIC_SR_IRQ(LPM3_bits);                     // Wake anyone waiting for the UART
+    }
+    else
+    {
+        CCTL0 |=  OUTMOD2;                          // TX Space
+        if (TxData & 0x01)
+            CCTL0 &= ~ OUTMOD2;                     // TX Mark
+        TxData = TxData >> 1;
+        TxBitCnt --;
     }
+    PROF_END(PROF_TIMER_A0, t0);
 }
 
-// Timer A0 interrupt service routine
-#pragma vector=TIMERA0_VECTOR
-__interrupt void Timer_A (void)
+// Timer A1 interrupt service routine, CCR1 receives
+#pragma vector=TIMER0_A1_VECTOR
+__interrupt void Timer_A1 (void)
 {
-    CCR0 += Bitime;                                 // Add Offset to CCR0
-
-    // TX
-    if (CCTL0 & CCIS0)                              // TX on CCI0B?
+    PROF_START(t0);
+    if(TA0IV != TA0IV_TACCR1)
+        return;
+    if( CCTL1 & CAP )                               // Capture mode = start bit edge
     {
-        if ( BitCnt == 0)
-            CCTL0 &= ~ CCIE;                        // All bits TXed, disable interrupt
-        else
-        {
-            CCTL0 |=  OUTMOD2;                      // TX Space
-            if (TxData & 0x01)
-                CCTL0 &= ~ OUTMOD2;                 // TX Mark
-            TxData = TxData >> 1;
-            BitCnt --;
-        }
+        CCTL1 = CCIE;                               // Switch from capture to compare mode
+        CCR1 += Bitime + Bitime/2;                  // CCR1 has the edge, sample mid bit
+        _BIC_SR_IRQ(LPM3_bits);                     // Timer_A needs SMCLK for the rest of the frame
     }
-    // RX
     else
     {
-        if( CCTL0 & CAP )                           // Capture mode = start bit edge
-        {
-            CCTL0 &= ~ CAP;                         // Switch from capture to compare mode
-            CCR0 += Bitime_5;                       //we do this at the top too..wtf?
+        CCR1 += Bitime;
+        RxData = RxData >> 1;
+        if(CCTL1 & SCCI){                           // RXD as it was at the compare
+            RxData |= 0x80;
         }
-        else
-        {
-            if(BitCnt<8){                               
-                RxData = RxData >> 1;
-                if(P1IN & RXD){                     // Get bit waiting in receive latch
-                    RxData |= 0x80;                 // input data
-                }
-            }
-            if(BitCnt>=8)
-            {
-                CCTL0 &= ~ CCIE;                    //All bits RXed, disable interrupt
-                //_BIC_SR_IRQ(LPM3_bits);           //Clear LPM3 bits from 0(SR)
-                P1IFG &= ~RXD;                      //for some reason the interrupt flag is set at the end, so clear it
-                recvFlag=1;
-            }
-            BitCnt++;                               
+        if(++RxBitCnt < 8){
+            PROF_END(PROF_TIMER_A1, t0);
+            return;
+        }
+        //All bits RXed. The stop bit isn't checked, so listen for the next
+        //start bit from here: a fast sender's comes early
+        CCTL1 &= ~ CCIE;
+        _BIC_SR_IRQ(LPM3_bits);                     //Clear LPM3 bits from 0(SR)
+        if((unsigned char)(rxHead-rxTail) < RX_BUF_SIZE){
+            rxBuf[rxHead & RX_BUF_MASK] = RxData;
+            rxHead++;
+        }else{
+            rxOverrun++;                            //getc is too slow, drop it
+            LOG(EV_OVERRUN, rxOverrun);
         }
+        RX_Ready();                                 //look for the next start bit right away
     }
+    PROF_END(PROF_TIMER_A1, t0);
 }
 
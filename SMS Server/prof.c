@@ -0,0 +1,74 @@
+/******************************************************************************
+ * Hot path profiler, see prof.h
+ *
+ * profRecord() may be called from interrupts and from code they interrupt,
+ * so it updates a slot with interrupts off. Counts stop at 65535 calls and
+ * the sums at 2^32 ticks; profDump() divides for the mean.
+ ******************************************************************************/
+
+#include  "msp430g2452.h"
+#include "cmd.h"
+#include "prof.h"
+
+#ifdef PROF
+
+struct profSlot {
+    unsigned int calls;
+    unsigned int min;
+    unsigned int max;
+    unsigned long sum;
+};
+
+struct profSlot profTable[PROF_COUNT];
+
+void profRecord(unsigned char slot, unsigned int start)
+{
+    unsigned int gie = __get_SR_register() & GIE;
+    unsigned int dt;
+    struct profSlot *p = &profTable[slot];
+    __disable_interrupt();
+    dt = TAR - start;                           //wraps once TACLK_HZ/65536 a second
+    if(p->calls != 0xFFFF){
+        if(!p->calls || dt < p->min){
+            p->min = dt;
+        }
+        if(dt > p->max){
+            p->max = dt;
+        }
+        p->calls++;
+        p->sum += dt;
+    }
+    if(gie){
+        __enable_interrupt();
+    }
+}
+
+//frames the table with tag, through putc(): waits on the UART, ~12 bytes a
+//slot
+void profDump(unsigned char tag)
+{
+    unsigned char buf[11], i;
+    struct profSlot s;
+    buf[0] = tag;
+    buf[1] = CMD_PROF | CMD_EVENT;
+    for(i=0; i<PROF_COUNT; i++){
+        __disable_interrupt();
+        s = profTable[i];
+        __enable_interrupt();
+        if(s.calls){
+            s.sum /= s.calls;
+        }
+        buf[2] = i;
+        buf[3] = s.calls >> 8;
+        buf[4] = s.calls;
+        buf[5] = s.min >> 8;
+        buf[6] = s.min;
+        buf[7] = s.max >> 8;
+        buf[8] = s.max;
+        buf[9] = s.sum >> 8;
+        buf[10] = s.sum;
+        frameSend(buf, 11);
+    }
+}
+
+#endif
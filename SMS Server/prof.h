@@ -0,0 +1,38 @@
+//Hot path profiler, shared by SMS Server and SMS Client.
+//
+//PROF_START() reads TAR on the way into a function and PROF_END() adds the
+//time since to the function's slot: calls, min, max and the sum for the
+//mean, in Timer_A ticks (8 SMCLK cycles). Times are wall times, so whatever
+//interrupts a function is in its figure. profDump() sends the table, one
+//frame per slot (cmd.h):
+//      tag, CMD_PROF|CMD_EVENT, slot, calls (2), min (2), max (2), mean (2), crc8
+//SMS Server sends it after each CMD_STATUS reply, with that tag; SMS Client
+//when a CMD_STATUS comes in, it doesn't answer otherwise.
+//
+//Uncomment (or -DPROF) to build it in. It costs 10 bytes of RAM a slot and
+//~30 cycles a call, in the UART interrupts too: not for 1MHz above 2400 baud.
+//#define PROF
+
+//slot, name for the host. Add to the end only, hosts go by slot.
+#define PROF_SLOTS(X) \
+    X(PROF_PUTBUFFER,   "putBuffer") \
+    X(PROF_GETBUFFER,   "getBuffer") \
+    X(PROF_SETRX,       "RF_24G_SetRx") \
+    X(PROF_SETTX,       "RF_24G_SetTx") \
+    X(PROF_TX_BYTE,     "TX_Byte") \
+    X(PROF_TIMER_A0,    "Timer_A (UART TX)") \
+    X(PROF_TIMER_A1,    "Timer_A1 (UART RX)")
+
+#define PROF_SLOT(slot, name)   slot,
+enum { PROF_SLOTS(PROF_SLOT) PROF_COUNT };
+
+#ifdef PROF
+#define PROF_START(t)           unsigned int t = TAR
+#define PROF_END(slot, t)       profRecord(slot, t)
+#else
+#define PROF_START(t)
+#define PROF_END(slot, t)
+#endif
+
+void profRecord(unsigned char slot, unsigned int start);
+void profDump(unsigned char tag);
@@ -27,9 +27,11 @@
 //////////////////////////////////////////////////////////////////////////////// 
 
 #include <stdint.h>
-#include  "msp430x20x2.h"
+#include  "msp430g2452.h"
+#include "prof.h"
 #include "binary.h"
 #include "rf24g_2.h"
+#include "clock.h"
 
 #define BIT_TEST(port, bit) ((port) & (bit))
 #define BIT_SET(port, bit) port |= (bit)
@@ -64,11 +66,39 @@
 #define RF_24G_DR1_DIR          P1DIR
 #define RF_24G_CS_DIR           P2DIR
 
+#define RF_24G_DR1_IE           P1IE
+#define RF_24G_DR1_IES          P1IES
+#define RF_24G_DR1_IFG          P1IFG
+
 #define RF_24G_CE_BIT           BIT6
+#define RF_24G_CLK1_BIT         BIT5    //USI SCLK
+#define RF_24G_CS_BIT           BIT7
+#ifdef RF_24G_USI
+#define RF_24G_DATA_BIT         BIT6    //USI SDO, tied to SDI (BIT7)
+#define RF_24G_DR1_BIT          BIT4
+#else
 #define RF_24G_DATA_BIT         BIT4
-#define RF_24G_CLK1_BIT         BIT5
 #define RF_24G_DR1_BIT          BIT7
-#define RF_24G_CS_BIT           BIT7
+#endif
+
+#ifdef RF_24G_RX2
+#define RF_24G_CLK2_PORT        P1OUT
+#define RF_24G_DOUT2_PORT       P1IN
+#define RF_24G_DR2_PORT         P1IN
+
+#define RF_24G_CLK2_DIR         P1DIR
+#define RF_24G_DOUT2_DIR        P1DIR
+#define RF_24G_DR2_DIR          P1DIR
+
+#define RF_24G_DR2_IE           P1IE
+#define RF_24G_DR2_IES          P1IES
+#define RF_24G_DR2_IFG          P1IFG
+#define RF_24G_DR2_REN          P1REN
+
+#define RF_24G_CLK2_BIT         BIT0    //LED1
+#define RF_24G_DOUT2_BIT        BIT6    //LED2
+#define RF_24G_DR2_BIT          BIT3    //S2
+#endif
 
 
 
@@ -81,19 +111,24 @@
 //    The total number of bits in a ShockBurst RF package may not exceed 256! 
 //    Maximum length of payload section is hence given by: 
 //    DATAx_W(bits) = 256 - ADDR_W - CRC 
-#define DATA2_W            RF_24G_PAYLOADSIZE * 8 
+#define DATA2_W            (RF_24G_PAYLOAD2SIZE * 8) 
 
 //Byte 13: Length of data payload section RX channel 1 in bits 
-#define DATA1_W            RF_24G_PAYLOADSIZE * 8 
+#define DATA1_W            (RF_24G_PAYLOADSIZE * 8) 
 
 //Byte 12-08: Channel 2 Address 
+//    Only the low RF_24G_ADDR_BYTES are used. Shared by every node, so what 
+//    is sent there is a broadcast; ADDR2_0 is not a node ID 
 #define ADDR2_4            0x00 
 #define ADDR2_3            0x00 
 #define ADDR2_2            0x00 
 #define ADDR2_1            0x42 
-#define ADDR2_0            0x42 
+#define ADDR2_0            0xFF 
 
 //Byte 07-03: Channel 1 Address 
+//    Only the low RF_24G_ADDR_BYTES are used. ADDR1_0 is replaced by the node 
+//    ID: RF_24G_Config() receives on its own, putBuffer() sends to 
+//    RF_24G_TxNode's 
 #define ADDR1_4            0x00 
 #define ADDR1_3            0x00 
 #define ADDR1_2            0x00 
@@ -119,6 +154,16 @@
 #define CRC_EN_DISABLE     b00000000 
 #define CRC_EN_ENABLE      b00000001 
 
+//from the frame layout in rf24g_2.h 
+#define ADDR_W             ((RF_24G_ADDR_BYTES * 8) << 2) 
+#if RF_24G_CRC_BITS == 16
+#define CRC_CONFIG         (CRC_L_16_BIT | CRC_EN_ENABLE) 
+#elif RF_24G_CRC_BITS == 8
+#define CRC_CONFIG         (CRC_L_8_BIT | CRC_EN_ENABLE) 
+#else
+#define CRC_CONFIG         (CRC_L_8_BIT | CRC_EN_DISABLE) 
+#endif
+
 //Byte 01 
 //    Bit    07: RX2_EN    - Enable two channel receive mode 
 //    Bit    06: CM        - Communication mode ( Direct or ShockBurst) 
@@ -130,6 +175,12 @@
 #define RX2_EN_DISABLE     b00000000 
 #define RX2_EN_ENABLE      b10000000 
 
+#ifdef RF_24G_RX2
+#define RX2_EN             RX2_EN_ENABLE 
+#else
+#define RX2_EN             RX2_EN_DISABLE 
+#endif
+
 #define CM_DIRECT          b00000000 
 #define CM_SHOCKBURST      b01000000 
 
@@ -152,18 +203,111 @@
 //    Bit    00: RXEN      - RX or TX operation 
 //    Combine (via |) together constants from each group 
 //                         b76543210 
-#define RF_CH              b10000000 // 64 - 2464GHz 
+#define RF_CH              b10000000 // 64 - 2464GHz, until RF_24G_SetChannel() 
 
 #define RXEN_TX            b00000000 
 #define RXEN_RX            b00000001 
 
 #define BUF_MAX            RF_24G_PAYLOADSIZE 
-uint8_t RF_24G_Buffer[BUF_MAX]; 
+uint8_t RF_24G_TxBuffer[BUF_MAX]; 
+uint8_t rxBuffer[RF_24G_RX_BUFS][BUF_MAX]; 
+#if RF_24G_RX_BUFS > 1
+uint8_t rxNext;                     //rxBuffer getBuffer() reads into 
+#else
+#define rxNext             0 
+#endif
+uint8_t RF_24G_TxNode = ADDR1_0; 
+uint8_t RF_24G_Channel = RF_CH >> 1; 
+uint8_t chPending;                  //RF_24G_Channel not shifted in yet 
+
+//channel 1 address as it goes on the air, MSB first, last byte unused 
+const uint8_t RF_24G_Addr1[RF_24G_ADDR_BYTES] = { 
+#if RF_24G_ADDR_BYTES >= 5
+    ADDR1_4, 
+#endif
+#if RF_24G_ADDR_BYTES >= 4
+    ADDR1_3, 
+#endif
+#if RF_24G_ADDR_BYTES >= 3
+    ADDR1_2, 
+#endif
+#if RF_24G_ADDR_BYTES >= 2
+    ADDR1_1, 
+#endif
+    ADDR1_0 
+}; 
+
+#ifdef RF_24G_RX2
+uint8_t RF_24G_Buffer2[RF_24G_PAYLOAD2SIZE]; 
+#endif
 //TODO do we need this delay business?
+//CLK1 has to stay high and low for 500ns, the bit-banged loops only get
+//that close at 16MHz
+#if MCLK_MHZ >= 16
+#define CLKDELAY()         __delay_cycles(4)
+#else
 #define CLKDELAY()         /*delay_us(1) */
+#endif
 #define CSDELAY()          /*delay_us(10)*/ 
 #define PWUPDELAY()        /*delay_ms(3) */
 
+#ifdef RF_24G_USI
+//The USI does the shifting: SPI master, SCLK idles low, DATA is captured on
+//the rising edge and changed on the falling one like the bit-banged version.
+//SCLK is SMCLK divided down to the RF-24G's 1MHz: about 8us a byte instead
+//of ~80 cycles of MCLK.
+#if MCLK_MHZ == 1
+#define RF_24G_USIDIV      USIDIV_0
+#elif MCLK_MHZ == 8
+#define RF_24G_USIDIV      USIDIV_3
+#else
+#define RF_24G_USIDIV      USIDIV_4
+#endif
+void RF_24G_init() 
+{ 
+    USICTL0 = USIPE7 + USIPE6 + USIPE5 + USIMST + USIOE + USISWRST;
+    USICTL1 = USICKPH;                  //MSB goes out as soon as USISRL is loaded
+    USICKCTL = RF_24G_USIDIV + USISSEL_2;   //SMCLK/MCLK_MHZ
+    USICTL0 &= ~USISWRST;
+    BIT_CLEAR(RF_24G_DR1_DIR, RF_24G_DR1_BIT);   //input
+    BIT_CLEAR(P2SEL, RF_24G_CE_BIT);    //Use as gpio
+    BIT_CLEAR(P2SEL, RF_24G_CS_BIT);    //Use as gpio
+    BIT_SET(RF_24G_CE_DIR, RF_24G_CE_BIT);    //output
+    BIT_SET(RF_24G_CS_DIR, RF_24G_CS_BIT);    //output
+} 
+
+void setOutput()
+{
+    BIT_SET(USICTL0, USIOE);    //SDO drives DATA
+}
+
+void setInput()
+{
+    BIT_CLEAR(USICTL0, USIOE);  //SDO lets go, the RF-24G drives DATA into SDI
+}
+
+void putByte( uint8_t b ) 
+{  
+    USISRL = b;
+    USICNT = 8;
+    while(!(USICTL1 & USIIFG));
+} 
+
+uint8_t getByte() 
+{  
+    USICNT = 8;
+    while(!(USICTL1 & USIIFG));
+    return USISRL;
+} 
+
+//single configuration bit, clocked in on the rising edge
+void putBit( uint8_t b ) 
+{
+    USISRL = b ? 0x80 : 0;
+    USICNT = 1;
+    while(!(USICTL1 & USIIFG));
+}
+#else
 void RF_24G_init() 
 { 
     BIT_SET(RF_24G_DATA_DIR, RF_24G_DATA_BIT);    //output
@@ -173,6 +317,13 @@ void RF_24G_init()
     BIT_CLEAR(P2SEL, RF_24G_CS_BIT);    //Use as gpio
     BIT_SET(RF_24G_CE_DIR, RF_24G_CE_BIT);    //output
     BIT_SET(RF_24G_CS_DIR, RF_24G_CS_BIT);    //output
+#ifdef RF_24G_RX2
+    BIT_CLEAR(RF_24G_CLK2_PORT, RF_24G_CLK2_BIT); 
+    BIT_SET(RF_24G_CLK2_DIR, RF_24G_CLK2_BIT);    //output
+    BIT_CLEAR(RF_24G_DOUT2_DIR, RF_24G_DOUT2_BIT);   //input
+    BIT_CLEAR(RF_24G_DR2_DIR, RF_24G_DR2_BIT);   //input
+    BIT_CLEAR(RF_24G_DR2_REN, RF_24G_DR2_BIT);   //no pull-up fighting DR2
+#endif
 } 
 
 void setOutput()
@@ -221,7 +372,44 @@ uint8_t getByte()
     return b; 
 } 
 
-void RF_24G_Config() 
+//single configuration bit, clocked in on the rising edge
+void putBit( uint8_t b ) 
+{
+    if(b){
+        BIT_SET(RF_24G_DATA_OUT_PORT, RF_24G_DATA_BIT); 
+    }else{
+        BIT_CLEAR(RF_24G_DATA_OUT_PORT, RF_24G_DATA_BIT); 
+    }
+    BIT_SET(RF_24G_CLK1_PORT, RF_24G_CLK1_BIT); 
+    CLKDELAY(); 
+    BIT_CLEAR(RF_24G_CLK1_PORT, RF_24G_CLK1_BIT); 
+    CLKDELAY(); 
+}
+#endif
+
+#ifdef RF_24G_RX2
+//channel 2 has its own clock and data line, always bit-banged 
+uint8_t getByte2() 
+{  
+    //MSB first 
+    int8_t i, b = 0; 
+    for(i=0 ; i < 8 ; i++) { 
+        BIT_CLEAR(RF_24G_CLK2_PORT, RF_24G_CLK2_BIT); 
+        CLKDELAY(); 
+        BIT_SET(RF_24G_CLK2_PORT, RF_24G_CLK2_BIT); 
+        CLKDELAY();           // Read before falling edge 
+        if( BIT_TEST(RF_24G_DOUT2_PORT, RF_24G_DOUT2_BIT) ) { 
+            b|=1;
+        } 
+        if(i!=7)
+            b<<=1;
+    } 
+    return b; 
+} 
+#endif
+
+//node: the low address byte this chip receives on 
+void RF_24G_Config(uint8_t node) 
 { 
     BIT_CLEAR(RF_24G_CE_PORT, RF_24G_CE_BIT); 
     BIT_CLEAR(RF_24G_CS_PORT, RF_24G_CS_BIT); 
@@ -243,12 +431,12 @@ void RF_24G_Config()
     putByte(ADDR1_3); 
     putByte(ADDR1_2); 
     putByte(ADDR1_1); 
-    putByte(ADDR1_0); 
-    putByte(ADDR_W_2_BYTE | CRC_L_16_BIT | CRC_EN_ENABLE); 
-    //putByte(ADDR_W_2_BYTE | CRC_L_8_BIT | CRC_EN_ENABLE); 
-    putByte(RX2_EN_DISABLE | CM_SHOCKBURST | RFDR_SB_1_MBPS | XO_F_16MHZ | RF_PWR_0DB); 
+    putByte(node); 
+    putByte(ADDR_W | CRC_CONFIG); 
+    putByte(RX2_EN | CM_SHOCKBURST | RFDR_SB_1_MBPS | XO_F_16MHZ | RF_PWR_0DB); 
     //putByte(RF_CH | RXEN_RX); 
-    putByte(RF_CH | RXEN_TX); 
+    putByte((RF_24G_Channel << 1) | RXEN_TX); 
+    chPending = 0; 
 
     //OUTPUT_FLOAT(RF_24G_DATA); 
     BIT_CLEAR(RF_24G_CE_PORT, RF_24G_CE_BIT); 
@@ -256,57 +444,80 @@ void RF_24G_Config()
     BIT_CLEAR(RF_24G_CLK1_PORT, RF_24G_CLK1_BIT); 
 } 
 
-// Once the wanted protocol, modus and RF channel are set, 
-// only one bit (RXEN) is shifted in to switch between RX and TX. 
+//RF channel ch (2400MHz + ch MHz) from the next RF_24G_SetTx()/SetRx() 
+void RF_24G_SetChannel(uint8_t ch) 
+{ 
+    if(ch != RF_24G_Channel){ 
+        RF_24G_Channel = ch; 
+        chPending = 1; 
+    } 
+} 
+
+//shifts in RXEN, and the channel in front of it if that changed: the last 
+//byte of the configuration word 
+void putMode(uint8_t rxen) 
+{ 
+    if(chPending){ 
+        putByte((RF_24G_Channel << 1) | rxen); 
+        chPending = 0; 
+    }else{ 
+        putBit(rxen); 
+    } 
+} 
+
+// Once the wanted protocol and modus are set, only RXEN is shifted in to 
+// switch to TX; putMode() puts the channel byte in front of it when 
+// RF_24G_SetChannel() changed the channel since. 
 void RF_24G_SetTx() 
 { 
+    PROF_START(t0); 
     setOutput();
     BIT_CLEAR(RF_24G_CE_PORT, RF_24G_CE_BIT); 
     BIT_SET(RF_24G_CS_PORT, RF_24G_CS_BIT); 
     CSDELAY(); 
-    BIT_CLEAR(RF_24G_DATA_OUT_PORT, RF_24G_DATA_BIT); 
-    BIT_SET(RF_24G_CLK1_PORT, RF_24G_CLK1_BIT); 
-    CLKDELAY(); 
-    BIT_CLEAR(RF_24G_CLK1_PORT, RF_24G_CLK1_BIT); 
-    CLKDELAY(); 
+    putMode(RXEN_TX); 
     BIT_CLEAR(RF_24G_CS_PORT, RF_24G_CS_BIT); 
     BIT_CLEAR(RF_24G_CLK1_PORT, RF_24G_CLK1_BIT); 
+    PROF_END(PROF_SETTX, t0); 
 } 
 
-// Once the wanted protocol, modus and RF channel are set, 
-// only one bit (RXEN) is shifted in to switch between RX and TX. 
+// Once the wanted protocol and modus are set, only RXEN is shifted in to 
+// switch to RX; putMode() puts the channel byte in front of it when 
+// RF_24G_SetChannel() changed the channel since. 
 void RF_24G_SetRx() 
 { 
+    PROF_START(t0); 
     setOutput();
     BIT_CLEAR(RF_24G_CE_PORT, RF_24G_CE_BIT); 
     BIT_SET(RF_24G_CS_PORT, RF_24G_CS_BIT); 
     CSDELAY(); 
-    BIT_SET(RF_24G_DATA_OUT_PORT, RF_24G_DATA_BIT); 
-    BIT_SET(RF_24G_CLK1_PORT, RF_24G_CLK1_BIT); 
-    CLKDELAY(); 
-    BIT_CLEAR(RF_24G_CLK1_PORT, RF_24G_CLK1_BIT); 
-    CLKDELAY(); 
+    putMode(RXEN_RX); 
     BIT_CLEAR(RF_24G_CS_PORT, RF_24G_CS_BIT); 
     //OUTPUT_FLOAT(RF_24G_DATA); 
     BIT_CLEAR(RF_24G_CLK1_PORT, RF_24G_CLK1_BIT); 
     BIT_SET(RF_24G_CE_PORT, RF_24G_CE_BIT); 
     setInput();
+    PROF_END(PROF_SETRX, t0); 
 } 
 
 void putBuffer() 
 { 
     int8_t i; 
+    PROF_START(t0); 
     BIT_SET(RF_24G_CE_PORT, RF_24G_CE_BIT); 
     CSDELAY(); 
 
-    putByte(ADDR1_1); 
-    putByte(ADDR1_0); 
-
+    for( i=0; i<RF_24G_ADDR_BYTES-1 ; i++) { 
+        putByte(RF_24G_Addr1[i]); 
+    } 
+    putByte(RF_24G_TxNode); 
     for( i=0; i<BUF_MAX ; i++) { 
-        putByte(RF_24G_Buffer[i]); 
+        putByte(RF_24G_TxBuffer[i]); 
     } 
     BIT_CLEAR(RF_24G_CE_PORT, RF_24G_CE_BIT); 
     BIT_CLEAR(RF_24G_CLK1_PORT, RF_24G_CLK1_BIT); 
+    PROF_END(PROF_PUTBUFFER, t0); 
+    __delay_cycles(RF_24G_TX_US * MCLK_MHZ);    //on the air, see rf24g_2.h 
 } 
 
 int hasData()
@@ -318,17 +529,87 @@ int hasData()
     }
 }
 
-void getBuffer() 
+//DR1 going high raises a port 1 interrupt, so the MCU can sleep until a
+//packet is ready
+void RF_24G_DR1IntEnable()
+{
+    BIT_CLEAR(RF_24G_DR1_IES, RF_24G_DR1_BIT);    //rising edge
+    BIT_CLEAR(RF_24G_DR1_IFG, RF_24G_DR1_BIT);
+    BIT_SET(RF_24G_DR1_IE, RF_24G_DR1_BIT);
+}
+
+//for the port 1 ISR: true (and the flag cleared) if DR1 went high
+int RF_24G_DR1Int()
+{
+    if(BIT_TEST(RF_24G_DR1_IFG, RF_24G_DR1_BIT)){
+        BIT_CLEAR(RF_24G_DR1_IFG, RF_24G_DR1_BIT);
+        return 1;
+    }
+    return 0;
+}
+
+//reads the packet waiting on DR1 into the next rxBuffer, and returns it 
+uint8_t *getBuffer() 
 { 
     int8_t i; 
+    uint8_t *buf = rxBuffer[rxNext]; 
+#if RF_24G_RX_BUFS > 1
+    if(++rxNext == RF_24G_RX_BUFS){ 
+        rxNext = 0; 
+    } 
+#endif
+    PROF_START(t0); 
     for( i=0; i<BUF_MAX ; i++) { 
-        RF_24G_Buffer[i] = getByte(); 
+        buf[i] = getByte(); 
     } 
     BIT_CLEAR(RF_24G_CLK1_PORT, RF_24G_CLK1_BIT); 
     //wait for DR1 to go low
     while(hasData());
     BIT_SET(RF_24G_CE_PORT, RF_24G_CE_BIT); 
+    PROF_END(PROF_GETBUFFER, t0); 
+    return buf; 
+} 
+
+#ifdef RF_24G_RX2
+int hasData2()
+{
+    if(BIT_TEST(RF_24G_DR2_PORT, RF_24G_DR2_BIT)){ 
+        return 1;
+    }else{
+        return 0;
+    }
+}
+
+//DR2 going high raises a port 1 interrupt, like DR1
+void RF_24G_DR2IntEnable()
+{
+    BIT_CLEAR(RF_24G_DR2_IES, RF_24G_DR2_BIT);    //rising edge
+    BIT_CLEAR(RF_24G_DR2_IFG, RF_24G_DR2_BIT);
+    BIT_SET(RF_24G_DR2_IE, RF_24G_DR2_BIT);
+}
+
+//for the port 1 ISR: true (and the flag cleared) if DR2 went high
+int RF_24G_DR2Int()
+{
+    if(BIT_TEST(RF_24G_DR2_IFG, RF_24G_DR2_BIT)){
+        BIT_CLEAR(RF_24G_DR2_IFG, RF_24G_DR2_BIT);
+        return 1;
+    }
+    return 0;
+}
+
+//reads the packet waiting on DR2 into RF_24G_Buffer2, channel 1 is untouched
+void getBuffer2() 
+{ 
+    int8_t i; 
+    for( i=0; i<RF_24G_PAYLOAD2SIZE ; i++) { 
+        RF_24G_Buffer2[i] = getByte2(); 
+    } 
+    BIT_CLEAR(RF_24G_CLK2_PORT, RF_24G_CLK2_BIT); 
+    //wait for DR2 to go low
+    while(hasData2());
 } 
+#endif
 
 //////////////////////////////////////////////////////////////////////////////// 
 //Example Setup: 
@@ -336,23 +617,22 @@ void getBuffer()
 //    RF_24G_initPorts(); 
 //    RF_24G_Config(); 
 //    RF_24G_SetRx();    // Switch to receive 
-//    RF_24G_Buffer[0] = 'A'; 
-//    RF_24G_Buffer[1] = 'B';  // Not used 
-//    RF_24G_Buffer[2] = 'C';  // Not used 
-//    RF_24G_Buffer[3] = 'D';  // Not used 
 // 
 //    while(1) { 
 //       if(BIT_TEST(RF_24G_DR1_PORT, RF_24G_DR1_BIT)){ 
-//          getBuffer();   // Get packet 
-//          putc(RF_24G_Buffer[0]); 
+//          pkt = getBuffer();   // Get packet 
+//          putc(pkt[0]); 
 //       } 
 // 
 // 
 //       // Transmit RF 
+//       RF_24G_TxBuffer[0] = 'A'; 
+//       RF_24G_TxBuffer[1] = 'B';  // Not used 
+//       RF_24G_TxBuffer[2] = 'C';  // Not used 
+//       RF_24G_TxBuffer[3] = 'D';  // Not used 
 //       RF_24G_SetTx();     // switch to transmit 
 //       delay_ms(1); 
-//       putBuffer();      // send packet (RF_24G_Buffer) 
-//       delay_ms(1);      // won't go back to recieve without this 
+//       putBuffer();      // send packet (RF_24G_TxBuffer), returns once it is out 
 //       RF_24G_SetRx();     // switch back to receive 
 //       delay_ms(1); 
 //    } 
@@ -1,12 +1,84 @@
-//Payload size
+//Uncomment to shift the 3-wire interface with the USI instead of bit-banging
+//it. Needs different wiring: DATA to both SDO (P1.6) and SDI (P1.7), DR1 on
+//P1.4. P1.6 is also LED2 on the LaunchPad, pull its jumper.
+//#define RF_24G_USI
+
+//Uncomment to receive on data channel 2 as well (RX2_EN), into RF_24G_Buffer2
+//with its own address and width. Channel 2 is 8MHz above channel 1. Takes
+//the LaunchPad's LED and button pins: CLK2 on P1.0, DOUT2 on P1.6, DR2 on
+//P1.3, so it needs the bit-banged driver and both LED jumpers pulled.
+//#define RF_24G_RX2
+
+//Frame layout. Override on the compiler command line to change it; every
+//node on a link has to agree. A ShockBurst frame (address, payload and CRC)
+//is at most 256 bits.
 typedef unsigned char uint8_t;
-#define RF_24G_PAYLOADSIZE      6 
-extern uint8_t RF_24G_Buffer[RF_24G_PAYLOADSIZE]; 
+#ifndef RF_24G_PAYLOADSIZE
+#define RF_24G_PAYLOADSIZE      10      //bytes: type, counter, hop, MAC, see door.h
+#endif
+#ifndef RF_24G_ADDR_BYTES
+#define RF_24G_ADDR_BYTES       2       //1 to 5
+#endif
+#ifndef RF_24G_CRC_BITS
+#define RF_24G_CRC_BITS         16      //0 (off), 8 or 16
+#endif
+#ifndef RF_24G_PAYLOAD2SIZE
+#define RF_24G_PAYLOAD2SIZE     RF_24G_PAYLOADSIZE      //bytes, channel 2
+#endif
+
+#if RF_24G_ADDR_BYTES < 1 || RF_24G_ADDR_BYTES > 5
+#error "RF_24G_ADDR_BYTES must be 1 to 5"
+#endif
+#if RF_24G_CRC_BITS != 0 && RF_24G_CRC_BITS != 8 && RF_24G_CRC_BITS != 16
+#error "RF_24G_CRC_BITS must be 0, 8 or 16"
+#endif
+#if RF_24G_PAYLOADSIZE < 1 || 8*(RF_24G_ADDR_BYTES + RF_24G_PAYLOADSIZE) + RF_24G_CRC_BITS > 256
+#error "RF-24G address, payload and CRC do not fit the 256 bit ShockBurst frame"
+#endif
+#if RF_24G_PAYLOAD2SIZE < 1 || 8*(RF_24G_ADDR_BYTES + RF_24G_PAYLOAD2SIZE) + RF_24G_CRC_BITS > 256
+#error "RF-24G channel 2 address, payload and CRC do not fit the 256 bit ShockBurst frame"
+#endif
+
+//ShockBurst TX from CE low: 195us to settle, then the preamble byte and the
+//frame at 1Mbps. Any configuration write before it is out (RF_24G_SetRx(),
+//RF_24G_SetChannel(), ...) cuts it off, so putBuffer() waits it out.
+#define RF_24G_TX_US            (195 + 8 + 8*(RF_24G_ADDR_BYTES + RF_24G_PAYLOADSIZE) + RF_24G_CRC_BITS)
+#if defined(RF_24G_RX2) && defined(RF_24G_USI)
+#error "RF_24G_RX2 needs P1.6 for DOUT2, the USI has it for SDO"
+#endif
+
+//Packet buffers. putBuffer() sends RF_24G_TxBuffer, and getBuffer() reads
+//into buffers of its own, so a message built once can go out again as it is.
+//Received packets go round RF_24G_RX_BUFS of them, each held until
+//RF_24G_RX_BUFS-1 more have been read. Each is RF_24G_PAYLOADSIZE bytes of
+//the G2452's 256 RAM, so SMS Server and SMS Client keep just the one.
+#ifndef RF_24G_RX_BUFS
+#define RF_24G_RX_BUFS          1
+#endif
+#if RF_24G_RX_BUFS < 1
+#error "RF_24G_RX_BUFS must be 1 or more"
+#endif
+
+extern uint8_t RF_24G_TxBuffer[RF_24G_PAYLOADSIZE]; 
+extern uint8_t RF_24G_TxNode;           //low address byte putBuffer() sends to
+extern uint8_t RF_24G_Channel;          //RF channel, RF_24G_SetChannel() changes it
 
 void RF_24G_init() ;
-void RF_24G_Config() ;
+void RF_24G_Config(uint8_t node) ;
 void RF_24G_SetTx() ;
 void RF_24G_SetRx() ;
+void RF_24G_SetChannel(uint8_t ch) ;
 void putBuffer() ;
-void getBuffer() ;
+uint8_t *getBuffer() ;
 int hasData();
+void RF_24G_DR1IntEnable() ;
+int RF_24G_DR1Int() ;
+
+//data channel 2, see RF_24G_RX2. No node sends on it yet
+#ifdef RF_24G_RX2
+extern uint8_t RF_24G_Buffer2[RF_24G_PAYLOAD2SIZE]; 
+void getBuffer2() ;
+int hasData2();
+void RF_24G_DR2IntEnable() ;
+int RF_24G_DR2Int() ;
+#endif
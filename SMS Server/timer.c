@@ -0,0 +1,67 @@
+/******************************************************************************
+ * Tick clock and one-shot timers
+ *
+ * The watchdog in interval mode interrupts every TICK_US. Each tick advances
+ * the clock and wakes the CPU when a timer has come due; what has to happen
+ * on a tick is left to the main loop, which compares tickCount.
+ *
+ * Timers count ticks, US_TICKS() makes them from a constant time. Deadlines
+ * are compared as a signed difference, so timers up to 32767 ticks (16
+ * seconds at 1MHz) work across the wrap.
+ ******************************************************************************/
+
+#include  "msp430g2452.h"
+#include "timer.h"
+
+volatile unsigned int tickCount;
+
+unsigned int deadline[TIMER_COUNT];
+volatile unsigned char timerOn;                 //bit per timer
+
+void InitializeTimers(void)
+{
+    tickCount=0;
+    timerOn=0;
+    WDTCTL = TICK_WDT;                          // Interval mode, TICK_US
+    IE1 |= WDTIE;
+}
+
+//(re)starts timer id to expire ticks from now
+void setTimer(unsigned char id, unsigned int ticks)
+{
+    deadline[id] = tickCount + ticks;
+    timerOn |= 1<<id;
+}
+
+void stopTimer(unsigned char id)
+{
+    timerOn &= ~(1<<id);
+}
+
+//true once when timer id has expired, which also stops it
+int timerExpired(unsigned char id)
+{
+    if((timerOn & (1<<id)) && (int)(tickCount - deadline[id]) >= 0){
+        timerOn &= ~(1<<id);
+        return 1;
+    }
+    return 0;
+}
+
+int timersPending(void)
+{
+    return timerOn != 0;
+}
+
+// Watchdog interval service routine
+#pragma vector=WDT_VECTOR
+__interrupt void Watchdog(void)
+{
+    unsigned char i;
+    tickCount++;
+    for(i=0; i<TIMER_COUNT; i++){
+        if((timerOn & (1<<i)) && (int)(tickCount - deadline[i]) >= 0){
+            _BIC_SR_IRQ(LPM3_bits);             //due, wake up whoever waits for it
+        }
+    }
+}
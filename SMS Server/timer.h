@@ -0,0 +1,23 @@
+//Tick clock and one-shot timers on the watchdog interval interrupt.
+//The watchdog runs off SMCLK, so the clock stops in LPM3/LPM4: only go that
+//deep when timersPending() is false.
+
+#include "clock.h"
+
+#if MCLK_MHZ == 1
+#define TICK_WDT                WDT_MDLY_0_5    //SMCLK/512
+#define TICK_US                 512
+#else
+#define TICK_WDT                WDT_MDLY_8      //SMCLK/8192
+#define TICK_US                 (8192/MCLK_MHZ)
+#endif
+#define US_TICKS(us)            (((us) + TICK_US/2) / TICK_US)     //rounded
+#define TIMER_COUNT             1       //SMS Client's door, SMS Server has none
+
+extern volatile unsigned int tickCount;         //free running, one per TICK_US
+
+void InitializeTimers(void);
+void setTimer(unsigned char id, unsigned int ticks);
+void stopTimer(unsigned char id);
+int timerExpired(unsigned char id);
+int timersPending(void);
@@ -0,0 +1,254 @@
+/******************************************************************************
+ * Virtual air between several simulated RF-24Gs
+ ******************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include "air.h"
+
+struct air_delivery {
+    struct sim_air_node *to;
+    uint32_t rnd;
+    struct sim_air_pkt p;
+};
+
+static uint32_t air_rand(uint32_t *rnd)
+{
+    uint32_t x = *rnd;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *rnd = x;
+    return x;
+}
+
+static int air_chance(uint32_t *rnd, unsigned pct)
+{
+    return pct && air_rand(rnd) % 100 < pct;
+}
+
+//garbles the bytes of p that share the air with other packets on its RF
+//channel; false if its preamble did, then it was never heard
+static int air_collide(struct sim_air *a, struct air_delivery *d)
+{
+    struct sim_air_pkt *p = &d->p;
+    unsigned n = a->sent < SIM_AIR_LOG ? a->sent : SIM_AIR_LOG;
+    unsigned i;
+    int k, hit = 0;
+    for(i=0; i<n; i++){
+        struct sim_air_pkt *o = &a->log[i];
+        uint64_t from;
+        if(o->seq == p->seq || o->rf_ch != p->rf_ch || o->end <= p->start || o->start >= p->end)
+            continue;
+        hit = 1;
+        from = p->start + RF_PREAMBLE * p->bit_ps;
+        if(o->start < from)
+            return 0;
+        for(k=0; k<p->len; k++, from += 8 * p->bit_ps)
+            if(o->start < from + 8 * p->bit_ps && o->end > from)
+                p->data[k] ^= air_rand(&d->rnd) % 255 + 1;     // never none
+    }
+    d->to->collided += hit;
+    return 1;
+}
+
+static void air_noise(struct sim_air *a, struct air_delivery *d)
+{
+    struct sim_air_pkt *p = &d->p;
+    int k, noisy = 0;
+    if(!a->ber)
+        return;
+    for(k=0; k<p->len * 8; k++){
+        if(air_rand(&d->rnd) % 1000000 < a->ber){
+            p->data[k / 8] ^= 0x80 >> (k % 8);
+            noisy = 1;
+        }
+    }
+    d->to->noisy += noisy;
+}
+
+static void air_arrive(void *ctx, struct sim_mcu *m, uint64_t t)
+{
+    struct air_delivery *d = ctx;
+    struct sim_air *a = d->to->a;
+    struct sim_air_pkt *p = &d->p;
+    struct sim_air_pkt *o = &a->log[p->seq % SIM_AIR_LOG];
+    (void)m;
+    if(o->seq == p->seq && o->cut){
+        //aborted after it was sent on its way
+    }else if(air_chance(&d->rnd, a->loss) || (p->rf_ch == a->jam_ch && air_chance(&d->rnd, a->jam))){
+        d->to->lost++;
+    }else if(!air_collide(a, d)){
+        d->to->collided++;
+    }else if(p->bit_ps != d->to->r->bit_ps){
+        d->to->r->filtered++;   // another data rate, no sync
+    }else{
+        air_noise(a, d);
+        if(sim_rfsrc_receive(d->to->r, t, p->start + a->latency, p->rf_ch, p->data, p->len)){
+            d->to->taken++;
+            d->to->crossed += a->node[p->from].net != d->to->net;
+        }
+    }
+    free(d);
+}
+
+//a member transmitted, from whichever thread runs its MCU
+static void air_recv(void *ctx, struct sim_rfsrc *r, uint8_t *payload, int len, uint64_t t)
+{
+    struct sim_air_node *n = ctx;
+    struct sim_air *a = n->a;
+    struct sim_air_pkt *p;
+    (void)payload;
+    (void)len;
+    (void)t;
+    pthread_mutex_lock(&a->lock);
+    if(a->npending == a->maxpending){
+        int max = a->maxpending ? a->maxpending * 2 : 16;
+        p = realloc(a->pending, max * sizeof(*p));
+        if(!p){
+            pthread_mutex_unlock(&a->lock);
+            return;
+        }
+        a->pending = p;
+        a->maxpending = max;
+    }
+    p = &a->pending[a->npending++];
+    p->from = n->id;
+    p->start = r->tx_start;
+    p->end = r->tx_end;
+    p->bit_ps = r->bit_ps;
+    p->rf_ch = r->tx_ch;
+    p->len = r->txlen;
+    memcpy(p->data, r->txbuf, r->txlen);
+    p->cut = 0;
+    pthread_mutex_unlock(&a->lock);
+}
+
+//a member aborted the packet it sent last, see sim_air_flush()
+static void air_cut(void *ctx, struct sim_rfsrc *r, uint64_t t)
+{
+    struct sim_air_node *n = ctx;
+    struct sim_air *a = n->a;
+    struct sim_air_cut *c;
+    (void)t;
+    pthread_mutex_lock(&a->lock);
+    if(a->ncuts == a->maxcuts){
+        int max = a->maxcuts ? a->maxcuts * 2 : 16;
+        c = realloc(a->cuts, max * sizeof(*c));
+        if(!c){
+            pthread_mutex_unlock(&a->lock);
+            return;
+        }
+        a->cuts = c;
+        a->maxcuts = max;
+    }
+    c = &a->cuts[a->ncuts++];
+    c->from = n->id;
+    c->start = r->tx_start;
+    c->end = r->tx_end;
+    pthread_mutex_unlock(&a->lock);
+}
+
+//the packet a cut is for, waiting to go or in the log, NULL if neither
+static struct sim_air_pkt *air_cut_pkt(struct sim_air *a, struct sim_air_cut *c)
+{
+    unsigned n = a->sent < SIM_AIR_LOG ? a->sent : SIM_AIR_LOG;
+    unsigned i;
+    int k;
+    for(k=0; k<a->npending; k++)
+        if(a->pending[k].from == c->from && a->pending[k].start == c->start)
+            return &a->pending[k];
+    for(i=0; i<n; i++)
+        if(a->log[i].from == c->from && a->log[i].start == c->start)
+            return &a->log[i];
+    return NULL;
+}
+
+static int air_cmp(const void *x, const void *y)
+{
+    const struct sim_air_pkt *p = x, *q = y;
+    if(p->start != q->start)
+        return p->start < q->start ? -1 : 1;
+    return p->from - q->from;
+}
+
+//only members tuned to a packet's RF channel now can have been settled in RX
+//before it starts
+static int air_tuned(struct sim_rfsrc *r, int rf_ch)
+{
+    return rf_ch == r->rf_ch || (r->rx2 && rf_ch == r->rf_ch + RF_CH2_OFFSET);
+}
+
+void sim_air_flush(struct sim_air *a)
+{
+    struct sim_air_pkt *p;
+    int i, k;
+    for(k=0; k<a->ncuts; k++){
+        if((p = air_cut_pkt(a, &a->cuts[k]))){
+            p->end = a->cuts[k].end;
+            p->cut = 1;
+        }
+    }
+    a->ncuts = 0;
+    qsort(a->pending, a->npending, sizeof(*a->pending), air_cmp);
+    for(k=0; k<a->npending; k++){
+        if(a->pending[k].cut && a->pending[k].end <= a->pending[k].start)
+            continue;                           // never on the air
+        p = &a->log[a->sent % SIM_AIR_LOG];
+        *p = a->pending[k];
+        p->seq = a->sent++;
+        if(p->cut)
+            continue;                           // only there to collide with
+        for(i=0; i<a->nodes; i++){
+            struct sim_air_node *n = &a->node[i];
+            struct air_delivery *d;
+            if(i == p->from)
+                continue;
+            if(!air_tuned(n->r, p->rf_ch)){
+                n->r->filtered++;
+                continue;
+            }
+            if(!(d = malloc(sizeof(*d))))
+                continue;
+            d->to = n;
+            d->rnd = air_rand(&a->rnd);
+            d->p = *p;
+            sim_at(n->r->m, p->end + a->latency, air_arrive, d);
+        }
+    }
+    a->npending = 0;
+}
+
+void sim_air_count(struct sim_air *a)
+{
+    int i;
+    a->lost = a->collided = a->noisy = a->taken = a->crossed = 0;
+    for(i=0; i<a->nodes; i++){
+        a->lost += a->node[i].lost;
+        a->collided += a->node[i].collided;
+        a->noisy += a->node[i].noisy;
+        a->taken += a->node[i].taken;
+        a->crossed += a->node[i].crossed;
+    }
+}
+
+void sim_air_init(struct sim_air *a)
+{
+    memset(a, 0, sizeof(*a));
+    a->jam_ch = -1;
+    a->rnd = 0x2545F491;
+    pthread_mutex_init(&a->lock, NULL);
+}
+
+void sim_air_join(struct sim_air *a, struct sim_rfsrc *r)
+{
+    struct sim_air_node *n;
+    if(a->nodes == SIM_AIR_NODES)
+        return;
+    n = &a->node[a->nodes];
+    n->a = a;
+    n->r = r;
+    n->id = a->nodes++;
+    r->recv = air_recv;
+    r->cut = air_cut;
+    r->ctx = n;
+}
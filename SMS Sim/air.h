@@ -0,0 +1,100 @@
+/******************************************************************************
+ * Virtual air between several simulated RF-24Gs
+ *
+ * What a member transmits is on the air from its tx_start to its tx_end on
+ * its RF channel, and reaches each of the other members `latency` after it
+ * ends, through sim_rfsrc_receive(): their own configuration, mode and CE
+ * decide whether they hear it. On the way:
+ *   - `loss` percent of packets do not reach a given member at all, and `jam`
+ *     percent more on RF channel `jam_ch`, Wi-Fi on it
+ *   - packets that overlap on one RF channel collide: a packet whose preamble
+ *     is hit is not heard, the bytes of the rest that share the air with
+ *     another packet are garbled, for the receiver's CRC to throw out
+ *   - `ber` bit errors per million bits flip bits at random; the CRC catches
+ *     those too, unless it is off
+ *
+ * The members' MCUs run in lock step, each on its own up to the end of a
+ * step, and sim_air_flush() between steps puts what they transmitted on the
+ * air. A packet starts RF_TX_SETTLE after CE drops, so with steps shorter
+ * than that it is out before anything it collides with ends, and the MCUs of
+ * one step may run on different threads: members only queue their packets
+ * (under `lock`), and a delivery only touches its receiver. Packets go out
+ * in start time order, each delivery with its own random numbers, so a run
+ * comes out the same however the steps were shared out.
+ *
+ * A packet its transmitter aborts (rfsrc.h) reaches no one. The abort is
+ * queued like a packet and applied by sim_air_flush(): one during
+ * RF_TX_SETTLE takes the packet off the air before it starts, one later
+ * leaves what went out to collide with. A packet cut short under a step
+ * before it ends may still arrive, if it does in that same step.
+ ******************************************************************************/
+#ifndef SIM_AIR_H
+#define SIM_AIR_H
+
+#include <pthread.h>
+#include "rfsrc.h"
+
+#define SIM_AIR_NODES   512
+#define SIM_AIR_LOG     256     // packets kept to check for collisions
+
+struct sim_air_pkt {
+    unsigned seq;
+    int from;                   // member
+    uint64_t start, end;
+    uint64_t bit_ps;
+    int rf_ch;
+    int len;                    // address, payload and CRC bytes
+    uint8_t data[RF_MAX_ADDR + RF_MAX_PAYLOAD + RF_MAX_CRC];
+    int cut;                    // aborted, `end` is when
+};
+
+//a member's packet that started at `start` was aborted, and ends at `end`
+struct sim_air_cut {
+    int from;
+    uint64_t start, end;
+};
+
+struct sim_air;
+
+struct sim_air_node {
+    struct sim_air *a;
+    struct sim_rfsrc *r;
+    int id;
+    int net;                    // installation it belongs to, 0 unless set
+    unsigned taken;             // packets it raised DR for
+    unsigned crossed;           // of those, from another installation
+    unsigned lost;              // packets that never reached it, loss and jam
+    unsigned collided;          // or reached it garbled by another packet
+    unsigned noisy;             // or with bit errors
+};
+
+struct sim_air {
+    struct sim_air_node node[SIM_AIR_NODES];
+    int nodes;
+    unsigned loss;              // percent, per packet and member
+    int jam_ch;                 // -1 for none
+    unsigned jam;
+    unsigned ber;               // bit errors per million bits
+    uint64_t latency;           // ps, end of a packet to DR
+    uint32_t rnd;
+
+    pthread_mutex_t lock;
+    struct sim_air_pkt *pending;    // transmitted since the last flush
+    int npending, maxpending;
+    struct sim_air_cut *cuts;       // and aborted
+    int ncuts, maxcuts;
+    struct sim_air_pkt log[SIM_AIR_LOG];
+
+    unsigned sent;              // packets put on the air
+    unsigned lost, collided, noisy;     // the members', sim_air_count()
+    unsigned taken, crossed;
+};
+
+void sim_air_init(struct sim_air *a);
+//r's packets go on the air and it hears the others'; takes r->recv and r->ctx
+void sim_air_join(struct sim_air *a, struct sim_rfsrc *r);
+//between steps: what the members transmitted goes on its way
+void sim_air_flush(struct sim_air *a);
+void sim_air_count(struct sim_air *a);
+
+#endif
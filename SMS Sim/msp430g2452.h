@@ -0,0 +1,436 @@
+/******************************************************************************
+ * Host stand-in for the TI msp430g2452.h device header (MSP430G2452)
+ *
+ * The firmware includes "msp430g2452.h" exactly as it does under CCS. When it
+ * is built for the simulator this file is found first on the include path and
+ * every special function register becomes an access into the simulated
+ * peripheral file of the MCU that is currently running (see sim.h). Each
+ * access costs cycles, so time advances and interrupts get dispatched the
+ * same way they would between two instructions on the real part.
+ *
+ * Addresses, bit names and vector numbers match the TI header so the firmware
+ * compiles unchanged. Only the peripherals the firmware uses are here: the
+ * G2231's set, which the G2452 has too, and none of its Comparator_A+ or
+ * Timer0_A3's CCR2.
+ ******************************************************************************/
+#ifndef SIM_MSP430G2452_H
+#define SIM_MSP430G2452_H
+
+#include <stdint.h>
+
+volatile uint8_t  *sim_reg8(unsigned addr);
+volatile uint16_t *sim_reg16(unsigned addr);
+void sim_sr_bis(unsigned bits);
+void sim_sr_bic(unsigned bits);
+void sim_sr_bis_on_exit(unsigned bits);
+void sim_sr_bic_on_exit(unsigned bits);
+unsigned sim_sr_get(void);
+void sim_delay_cycles(unsigned long n);
+
+#define SIM_SFR8(addr)      (*sim_reg8(addr))
+#define SIM_SFR16(addr)     (*sim_reg16(addr))
+
+/************************************************************
+* STANDARD BITS
+************************************************************/
+#define BIT0                (0x0001)
+#define BIT1                (0x0002)
+#define BIT2                (0x0004)
+#define BIT3                (0x0008)
+#define BIT4                (0x0010)
+#define BIT5                (0x0020)
+#define BIT6                (0x0040)
+#define BIT7                (0x0080)
+#define BIT8                (0x0100)
+#define BIT9                (0x0200)
+#define BITA                (0x0400)
+#define BITB                (0x0800)
+#define BITC                (0x1000)
+#define BITD                (0x2000)
+#define BITE                (0x4000)
+#define BITF                (0x8000)
+
+/************************************************************
+* STATUS REGISTER BITS
+************************************************************/
+#define C                   (0x0001)
+#define Z                   (0x0002)
+#define N                   (0x0004)
+#define V                   (0x0100)
+#define GIE                 (0x0008)
+#define CPUOFF              (0x0010)
+#define OSCOFF              (0x0020)
+#define SCG0                (0x0040)
+#define SCG1                (0x0080)
+
+#define LPM0_bits           (CPUOFF)
+#define LPM1_bits           (SCG0+CPUOFF)
+#define LPM2_bits           (SCG1+CPUOFF)
+#define LPM3_bits           (SCG1+SCG0+CPUOFF)
+#define LPM4_bits           (SCG1+SCG0+OSCOFF+CPUOFF)
+
+/************************************************************
+* INTRINSICS
+************************************************************/
+#define __interrupt
+#define __enable_interrupt()            sim_sr_bis(GIE)
+#define __disable_interrupt()           sim_sr_bic(GIE)
+#define __bis_SR_register(x)            sim_sr_bis(x)
+#define __bic_SR_register(x)            sim_sr_bic(x)
+#define __bis_SR_register_on_exit(x)    sim_sr_bis_on_exit(x)
+#define __bic_SR_register_on_exit(x)    sim_sr_bic_on_exit(x)
+#define __get_SR_register()             sim_sr_get()
+#define __no_operation()                sim_delay_cycles(1)
+#define __delay_cycles(x)               sim_delay_cycles(x)
+#define _EINT()                         __enable_interrupt()
+#define _DINT()                         __disable_interrupt()
+#define _NOP()                          __no_operation()
+#define _BIS_SR(x)                      __bis_SR_register(x)
+#define _BIC_SR(x)                      __bic_SR_register(x)
+#define _BIS_SR_IRQ(x)                  __bis_SR_register_on_exit(x)
+#define _BIC_SR_IRQ(x)                  __bic_SR_register_on_exit(x)
+
+#define LPM0      _BIS_SR(LPM0_bits)
+#define LPM0_EXIT _BIC_SR_IRQ(LPM0_bits)
+#define LPM3      _BIS_SR(LPM3_bits)
+#define LPM3_EXIT _BIC_SR_IRQ(LPM3_bits)
+
+/************************************************************
+* SPECIAL FUNCTION REGISTER ADDRESSES + CONTROL BITS
+************************************************************/
+#define IE1                 SIM_SFR8(0x0000)
+#define WDTIE               (0x01)
+#define OFIE                (0x02)
+#define NMIIE               (0x10)
+#define ACCVIE              (0x20)
+
+#define IFG1                SIM_SFR8(0x0002)
+#define WDTIFG              (0x01)
+#define OFIFG               (0x02)
+#define PORIFG              (0x04)
+#define RSTIFG              (0x08)
+#define NMIIFG              (0x10)
+
+/************************************************************
+* Basic Clock Module
+************************************************************/
+#define DCOCTL              SIM_SFR8(0x0056)
+#define BCSCTL1             SIM_SFR8(0x0057)
+#define BCSCTL2             SIM_SFR8(0x0058)
+#define BCSCTL3             SIM_SFR8(0x0053)
+
+#define MOD0                (0x01)
+#define MOD1                (0x02)
+#define MOD2                (0x04)
+#define MOD3                (0x08)
+#define MOD4                (0x10)
+#define DCO0                (0x20)
+#define DCO1                (0x40)
+#define DCO2                (0x80)
+
+#define RSEL0               (0x01)
+#define RSEL1               (0x02)
+#define RSEL2               (0x04)
+#define RSEL3               (0x08)
+#define DIVA0               (0x10)
+#define DIVA1               (0x20)
+#define XTS                 (0x40)
+#define XT2OFF              (0x80)
+
+#define DIVA_0              (0x00)
+#define DIVA_1              (0x10)
+#define DIVA_2              (0x20)
+#define DIVA_3              (0x30)
+
+#define DCOR                (0x01)
+#define DIVS0               (0x02)
+#define DIVS1               (0x04)
+#define SELS                (0x08)
+#define DIVM0               (0x10)
+#define DIVM1               (0x20)
+#define SELM0               (0x40)
+#define SELM1               (0x80)
+
+#define DIVM_0              (0x00)
+#define DIVM_1              (0x10)
+#define DIVM_2              (0x20)
+#define DIVM_3              (0x30)
+#define DIVS_0              (0x00)
+#define DIVS_1              (0x02)
+#define DIVS_2              (0x04)
+#define DIVS_3              (0x06)
+#define SELM_0              (0x00)
+#define SELM_1              (0x40)
+#define SELM_2              (0x80)
+#define SELM_3              (0xC0)
+
+#define LFXT1OF             (0x01)
+#define XT2OF               (0x02)
+#define XCAP0               (0x04)
+#define XCAP1               (0x08)
+#define LFXT1S0             (0x10)
+#define LFXT1S1             (0x20)
+#define XT2S0               (0x40)
+#define XT2S1               (0x80)
+
+#define XCAP_0              (0x00)
+#define XCAP_1              (0x04)
+#define XCAP_2              (0x08)
+#define XCAP_3              (0x0C)
+#define LFXT1S_0            (0x00)
+#define LFXT1S_1            (0x10)
+#define LFXT1S_2            (0x20)
+#define LFXT1S_3            (0x30)
+
+/************************************************************
+* DIGITAL I/O Port1/2
+************************************************************/
+#define P1IN                SIM_SFR8(0x0020)
+#define P1OUT               SIM_SFR8(0x0021)
+#define P1DIR               SIM_SFR8(0x0022)
+#define P1IFG               SIM_SFR8(0x0023)
+#define P1IES               SIM_SFR8(0x0024)
+#define P1IE                SIM_SFR8(0x0025)
+#define P1SEL               SIM_SFR8(0x0026)
+#define P1REN               SIM_SFR8(0x0027)
+
+#define P2IN                SIM_SFR8(0x0028)
+#define P2OUT               SIM_SFR8(0x0029)
+#define P2DIR               SIM_SFR8(0x002A)
+#define P2IFG               SIM_SFR8(0x002B)
+#define P2IES               SIM_SFR8(0x002C)
+#define P2IE                SIM_SFR8(0x002D)
+#define P2SEL               SIM_SFR8(0x002E)
+#define P2REN               SIM_SFR8(0x002F)
+
+/************************************************************
+* Timer0_A3, CCR0 and CCR1
+************************************************************/
+#define TA0IV               SIM_SFR16(0x012E)
+#define TACTL               SIM_SFR16(0x0160)
+#define TACCTL0             SIM_SFR16(0x0162)
+#define TACCTL1             SIM_SFR16(0x0164)
+#define TAR                 SIM_SFR16(0x0170)
+#define TACCR0              SIM_SFR16(0x0172)
+#define TACCR1              SIM_SFR16(0x0174)
+
+/* Alternate register names */
+#define CCTL0               TACCTL0
+#define CCTL1               TACCTL1
+#define CCR0                TACCR0
+#define CCR1                TACCR1
+
+#define TASSEL1             (0x0200)
+#define TASSEL0             (0x0100)
+#define ID1                 (0x0080)
+#define ID0                 (0x0040)
+#define MC1                 (0x0020)
+#define MC0                 (0x0010)
+#define TACLR               (0x0004)
+#define TAIE                (0x0002)
+#define TAIFG               (0x0001)
+
+#define MC_0                (0*0x10u)
+#define MC_1                (1*0x10u)
+#define MC_2                (2*0x10u)
+#define MC_3                (3*0x10u)
+#define ID_0                (0*0x40u)
+#define ID_1                (1*0x40u)
+#define ID_2                (2*0x40u)
+#define ID_3                (3*0x40u)
+#define TASSEL_0            (0*0x100u)
+#define TASSEL_1            (1*0x100u)
+#define TASSEL_2            (2*0x100u)
+#define TASSEL_3            (3*0x100u)
+
+#define CM1                 (0x8000)
+#define CM0                 (0x4000)
+#define CCIS1               (0x2000)
+#define CCIS0               (0x1000)
+#define SCS                 (0x0800)
+#define SCCI                (0x0400)
+#define CAP                 (0x0100)
+#define OUTMOD2             (0x0080)
+#define OUTMOD1             (0x0040)
+#define OUTMOD0             (0x0020)
+#define CCIE                (0x0010)
+#define CCI                 (0x0008)
+#define OUT                 (0x0004)
+#define COV                 (0x0002)
+#define CCIFG               (0x0001)
+
+#define OUTMOD_0            (0*0x20u)
+#define OUTMOD_1            (1*0x20u)
+#define OUTMOD_2            (2*0x20u)
+#define OUTMOD_3            (3*0x20u)
+#define OUTMOD_4            (4*0x20u)
+#define OUTMOD_5            (5*0x20u)
+#define OUTMOD_6            (6*0x20u)
+#define OUTMOD_7            (7*0x20u)
+#define CCIS_0              (0*0x1000u)
+#define CCIS_1              (1*0x1000u)
+#define CCIS_2              (2*0x1000u)
+#define CCIS_3              (3*0x1000u)
+#define CM_0                (0*0x4000u)
+#define CM_1                (1*0x4000u)
+#define CM_2                (2*0x4000u)
+#define CM_3                (3*0x4000u)
+
+#define TA0IV_NONE          (0x0000)
+#define TA0IV_TACCR1        (0x0002)
+#define TA0IV_TAIFG         (0x000A)
+
+/************************************************************
+* USI
+************************************************************/
+#define USICTL0             SIM_SFR8(0x0078)
+#define USICTL1             SIM_SFR8(0x0079)
+#define USICKCTL            SIM_SFR8(0x007A)
+#define USICNT              SIM_SFR8(0x007B)
+#define USISRL              SIM_SFR8(0x007C)
+#define USISRH              SIM_SFR8(0x007D)
+#define USISR               SIM_SFR16(0x007C)
+
+#define USIPE7              (0x80)
+#define USIPE6              (0x40)
+#define USIPE5              (0x20)
+#define USILSB              (0x10)
+#define USIMST              (0x08)
+#define USIGE               (0x04)
+#define USIOE               (0x02)
+#define USISWRST            (0x01)
+
+#define USICKPH             (0x80)
+#define USII2C              (0x40)
+#define USISTTIE            (0x20)
+#define USIIE               (0x10)
+#define USIAL               (0x08)
+#define USISTP              (0x04)
+#define USISTTIFG           (0x02)
+#define USIIFG              (0x01)
+
+#define USIDIV2             (0x80)
+#define USIDIV1             (0x40)
+#define USIDIV0             (0x20)
+#define USISSEL2            (0x10)
+#define USISSEL1            (0x08)
+#define USISSEL0            (0x04)
+#define USICKPL             (0x02)
+#define USISWCLK            (0x01)
+
+#define USIDIV_0            (0x00)
+#define USIDIV_1            (0x20)
+#define USIDIV_2            (0x40)
+#define USIDIV_3            (0x60)
+#define USIDIV_4            (0x80)
+#define USIDIV_5            (0xA0)
+#define USIDIV_6            (0xC0)
+#define USIDIV_7            (0xE0)
+#define USISSEL_0           (0x00)
+#define USISSEL_1           (0x04)
+#define USISSEL_2           (0x08)
+#define USISSEL_3           (0x0C)
+#define USISSEL_4           (0x10)
+
+#define USISCLREL           (0x80)
+#define USI16B              (0x40)
+#define USIIFGCC            (0x20)
+#define USICNT4             (0x10)
+#define USICNT3             (0x08)
+#define USICNT2             (0x04)
+#define USICNT1             (0x02)
+#define USICNT0             (0x01)
+
+/************************************************************
+* WATCHDOG TIMER
+************************************************************/
+#define WDTCTL              SIM_SFR16(0x0120)
+#define WDTPW               (0x5A00)
+
+#define WDTIS0              (0x0001)
+#define WDTIS1              (0x0002)
+#define WDTSSEL             (0x0004)
+#define WDTCNTCL            (0x0008)
+#define WDTTMSEL            (0x0010)
+#define WDTNMI              (0x0020)
+#define WDTNMIES            (0x0040)
+#define WDTHOLD             (0x0080)
+
+/* WDT-interval times [1ms] coded with Bits 0-2 */
+/* WDT is clocked by fSMCLK (assumed 1MHz) */
+#define WDT_MDLY_32         (WDTPW+WDTTMSEL+WDTCNTCL)
+#define WDT_MDLY_8          (WDTPW+WDTTMSEL+WDTCNTCL+WDTIS0)
+#define WDT_MDLY_0_5        (WDTPW+WDTTMSEL+WDTCNTCL+WDTIS1)
+#define WDT_MDLY_0_064      (WDTPW+WDTTMSEL+WDTCNTCL+WDTIS1+WDTIS0)
+/* WDT is clocked by fACLK (assumed 32KHz) */
+#define WDT_ADLY_1000       (WDTPW+WDTTMSEL+WDTCNTCL+WDTSSEL)
+#define WDT_ADLY_250        (WDTPW+WDTTMSEL+WDTCNTCL+WDTSSEL+WDTIS0)
+#define WDT_ADLY_16         (WDTPW+WDTTMSEL+WDTCNTCL+WDTSSEL+WDTIS1)
+#define WDT_ADLY_1_9        (WDTPW+WDTTMSEL+WDTCNTCL+WDTSSEL+WDTIS1+WDTIS0)
+
+/************************************************************
+* Flash Memory
+************************************************************/
+#define FCTL1               SIM_SFR16(0x0128)
+#define FCTL2               SIM_SFR16(0x012A)
+#define FCTL3               SIM_SFR16(0x012C)
+
+#define FRKEY               (0x9600)
+#define FWKEY               (0xA500)
+
+#define ERASE               (0x0002)
+#define MERAS               (0x0004)
+#define WRT                 (0x0040)
+#define BLKWRT              (0x0080)
+
+#define FN0                 (0x0001)
+#define FN1                 (0x0002)
+#define FN2                 (0x0004)
+#define FN3                 (0x0008)
+#define FN4                 (0x0010)
+#define FN5                 (0x0020)
+#define FSSEL0              (0x0040)
+#define FSSEL1              (0x0080)
+#define FSSEL_0             (0x0000)    /* ACLK */
+#define FSSEL_1             (0x0040)    /* MCLK */
+#define FSSEL_2             (0x0080)    /* SMCLK */
+#define FSSEL_3             (0x00C0)    /* SMCLK */
+
+#define BUSY                (0x0001)
+#define KEYV                (0x0002)
+#define ACCVIFG             (0x0004)
+#define WAIT                (0x0008)
+#define LOCK                (0x0010)
+#define EMEX                (0x0020)
+#define LOCKA               (0x0040)
+#define FAIL                (0x0080)
+
+/************************************************************
+* Calibration Data in Info Mem
+************************************************************/
+/* the G2xx2 only ship the 1MHz pair, the simulator has all three */
+#define CALDCO_16MHZ        SIM_SFR8(0x10F8)
+#define CALBC1_16MHZ        SIM_SFR8(0x10F9)
+#define CALDCO_8MHZ         SIM_SFR8(0x10FC)
+#define CALBC1_8MHZ         SIM_SFR8(0x10FD)
+#define CALDCO_1MHZ         SIM_SFR8(0x10FE)
+#define CALBC1_1MHZ         SIM_SFR8(0x10FF)
+
+/* info.h's accessors, the TI header has none */
+#define INFO_BYTE(addr)     SIM_SFR8(addr)
+#define INFO_WORD(addr)     SIM_SFR16(addr)
+
+/************************************************************
+* Interrupt Vectors (offset from 0xFFE0)
+************************************************************/
+#define PORT1_VECTOR        (2 * 1u)  /* 0xFFE4 Port 1 */
+#define PORT2_VECTOR        (3 * 1u)  /* 0xFFE6 Port 2 */
+#define USI_VECTOR          (4 * 1u)  /* 0xFFE8 USI */
+#define ADC10_VECTOR        (5 * 1u)  /* 0xFFEA ADC10 */
+#define TIMER0_A1_VECTOR    (8 * 1u)  /* 0xFFF0 Timer0_A CC1-2, TA */
+#define TIMER0_A0_VECTOR    (9 * 1u)  /* 0xFFF2 Timer0_A CC0 */
+#define WDT_VECTOR          (10 * 1u) /* 0xFFF4 Watchdog Timer */
+#define NMI_VECTOR          (14 * 1u) /* 0xFFFC Non-maskable */
+#define RESET_VECTOR        (15 * 1u) /* 0xFFFE Reset [Highest Priority] */
+
+#endif
@@ -0,0 +1,402 @@
+/******************************************************************************
+ * Stub ShockBurst transceiver on the RF-24G data channel 1 and 2 pins
+ ******************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include "rfsrc.h"
+
+#define RF_NONE         UINT64_MAX      // rx_since when not listening
+
+struct rfsrc_air {
+    struct sim_rfsrc *r;
+    int rf_ch;
+    uint8_t addr[RF_MAX_ADDR];
+    int len;
+    uint8_t payload[RF_MAX_PAYLOAD];
+};
+
+static int rfsrc_chance(struct sim_rfsrc *r, unsigned pct)
+{
+    uint32_t x = r->rnd;
+    if(!pct)
+        return 0;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    r->rnd = x;
+    return x % 100 < pct;
+}
+
+//a packet on RF channel rf_ch does not make it
+static int rfsrc_lost(struct sim_rfsrc *r, int rf_ch)
+{
+    if(rf_ch == r->jam_ch && rfsrc_chance(r, r->jam))
+        return 1;
+    return rfsrc_chance(r, r->loss);
+}
+
+static int rfsrc_listening(struct sim_rfsrc *r)
+{
+    uint8_t ctl = r->m->drive[RF_PORT_CTL];
+    return r->rx && (ctl & RF_PIN_CE) && !(ctl & RF_PIN_CS);
+}
+
+//settled in RX by the time a packet started, and still there
+static int rfsrc_heard(struct sim_rfsrc *r, uint64_t start)
+{
+    return rfsrc_listening(r) && r->rx_since + RF_RX_SETTLE <= start;
+}
+
+//ShockBurst CRC over address and payload, MSB first from all ones: CCITT
+//x^16+x^12+x^5+1, or x^8+x^2+x+1; bits 0 for none
+uint16_t sim_rf_crc(const uint8_t *p, int n, int bits)
+{
+    uint16_t poly = bits == 16 ? 0x1021 : 0x07;
+    uint16_t mask = bits == 16 ? 0xFFFF : 0xFF;
+    uint16_t crc = mask;
+    int i;
+    if(!bits)
+        return 0;
+    while(n--){
+        crc ^= *p++ << (bits - 8);
+        for(i=0; i<8; i++)
+            crc = (crc & (1 << (bits - 1))) ? (crc << 1) ^ poly : crc << 1;
+        crc &= mask;
+    }
+    return crc;
+}
+
+//appends the CRC of the n bytes at p, returns the new length
+static int rfsrc_add_crc(struct sim_rfsrc *r, uint8_t *p, int n)
+{
+    uint16_t crc = sim_rf_crc(p, n, r->crc_bits);
+    if(r->crc_bits == 16)
+        p[n++] = crc >> 8;
+    if(r->crc_bits)
+        p[n++] = crc;
+    return n;
+}
+
+static int rfsrc_bit(struct sim_rfch *c)
+{
+    return (c->payload[c->bit / 8] >> (7 - c->bit % 8)) & 1;
+}
+
+//packet ready: first bit on DATA, then DR high
+static void rfsrc_ready(struct sim_rfsrc *r, struct sim_rfch *c, uint64_t t)
+{
+    c->bit = 0;
+    sim_pin_drive(r->m, t, RF_PORT_DATA, c->data_in, rfsrc_bit(c));
+    sim_pin_drive(r->m, t, RF_PORT_DATA, c->dr, 1);
+    c->t_ready = t;
+}
+
+static void rfsrc_flush(struct sim_rfsrc *r, struct sim_rfch *c, uint64_t t)
+{
+    if(c->bit >= 0){
+        c->bit = -1;
+        sim_pin_drive(r->m, t, RF_PORT_DATA, c->dr, 0);
+    }
+}
+
+//the receive channel a packet is for, NULL if neither
+static struct sim_rfch *rfsrc_match(struct sim_rfsrc *r, int rf_ch, const uint8_t *pkt, int len)
+{
+    int skip = RF_MAX_ADDR - r->addr_bytes;
+    int i;
+    for(i=0; i<2; i++){
+        struct sim_rfch *c = &r->ch[i];
+        if(i && !r->rx2)
+            break;
+        if(rf_ch == r->rf_ch + i * RF_CH2_OFFSET && len >= r->addr_bytes
+           && !memcmp(pkt, c->addr + skip, r->addr_bytes))
+            return c;
+    }
+    return NULL;
+}
+
+int sim_rfsrc_receive(struct sim_rfsrc *r, uint64_t t, uint64_t start, int rf_ch,
+                      const uint8_t *pkt, int len)
+{
+    struct sim_rfch *c;
+    int n, w, crc_bytes = r->crc_bits / 8;
+    if(rfsrc_lost(r, rf_ch)){
+        r->dropped++;
+        return 0;
+    }
+    if(!(c = rfsrc_match(r, rf_ch, pkt, len))){
+        r->filtered++;
+        return 0;
+    }
+    if(!rfsrc_heard(r, start) || c->bit >= 0){
+        c->missed++;
+        return 0;
+    }
+    //its own payload width, or the rest of the packet before it has one
+    n = r->addr_bytes;
+    w = c->width ? c->width : len - n - crc_bytes;
+    if(w > RF_MAX_PAYLOAD)
+        w = RF_MAX_PAYLOAD;
+    if(w <= 0 || (crc_bytes && (len < n + w + crc_bytes
+       || sim_rf_crc(pkt, n + w, r->crc_bits)
+          != (crc_bytes == 2 ? pkt[n + w] << 8 | pkt[n + w + 1] : pkt[n + w])))){
+        r->crc_errors++;
+        return 0;
+    }
+    //the receiver always shifts out a full payload
+    memset(c->payload, 0, sizeof(c->payload));
+    memcpy(c->payload, pkt + n, len - n < w ? len - n : w);
+    c->len = w;
+    rfsrc_ready(r, c, t);
+    return 1;
+}
+
+//a stub's packet, sent the way the receiver is set up to take it
+static void rfsrc_arrive(void *ctx, struct sim_mcu *m, uint64_t t)
+{
+    struct rfsrc_air *a = ctx;
+    struct sim_rfsrc *r = a->r;
+    struct sim_rfch *c = &r->ch[a->rf_ch == r->rf_ch + RF_CH2_OFFSET];
+    uint8_t pkt[RF_MAX_ADDR + RF_MAX_PAYLOAD + RF_MAX_CRC];
+    int n = r->addr_bytes, w = c->width ? c->width : a->len;
+    uint64_t air;
+    (void)m;
+    memcpy(pkt, a->addr + RF_MAX_ADDR - n, n);
+    memset(pkt + n, 0, w);
+    memcpy(pkt + n, a->payload, a->len < w ? a->len : w);
+    n = rfsrc_add_crc(r, pkt, n + w);
+    air = (RF_PREAMBLE + n * 8) * r->bit_ps;
+    sim_rfsrc_receive(r, t, t > air ? t - air : 0, a->rf_ch, pkt, n);
+    free(a);
+}
+
+//packet on the air towards addr that ends at t, DR rises then if that is the
+//MCU and it is listening on rf_ch
+void sim_rfsrc_send(struct sim_rfsrc *r, uint64_t t, int rf_ch, const uint8_t *addr,
+                    const uint8_t *payload, int len)
+{
+    struct rfsrc_air *a = malloc(sizeof(*a));
+    if(!a)
+        return;
+    a->r = r;
+    a->rf_ch = rf_ch;
+    memcpy(a->addr, addr, RF_MAX_ADDR);
+    a->len = len > RF_MAX_PAYLOAD ? RF_MAX_PAYLOAD : len;
+    memcpy(a->payload, payload, a->len);
+    sim_at(r->m, t, rfsrc_arrive, a);
+}
+
+static void rfsrc_tick(void *ctx, struct sim_mcu *m, uint64_t t)
+{
+    struct sim_rfsrc *r = ctx;
+    if(r->next)
+        r->next(r->ctx, r, r->periodic, r->periodic_len, t);
+    sim_rfsrc_send(r, t, r->periodic_ch, r->periodic_addr, r->periodic, r->periodic_len);
+    sim_at(m, t + r->period, rfsrc_tick, r);
+}
+
+void sim_rfsrc_periodic(struct sim_rfsrc *r, uint64_t first, uint64_t period,
+                        int rf_ch, const uint8_t *addr, const uint8_t *payload, int len)
+{
+    r->period = period;
+    r->periodic_ch = rf_ch;
+    memcpy(r->periodic_addr, addr, RF_MAX_ADDR);
+    r->periodic_len = len > RF_MAX_PAYLOAD ? RF_MAX_PAYLOAD : len;
+    memcpy(r->periodic, payload, r->periodic_len);
+    sim_at(r->m, first, rfsrc_tick, r);
+}
+
+//CE dropped in TX mode: the clocked address and payload go on the air with
+//their CRC once the transmitter has settled
+static void rfsrc_transmit(struct sim_rfsrc *r, uint64_t t)
+{
+    int len = r->txbits / 8 - r->addr_bytes;
+    if(len <= 0)
+        return;
+    r->txlen = rfsrc_add_crc(r, r->txbuf, r->txbits / 8);
+    r->tx_start = t + RF_TX_SETTLE;
+    r->tx_end = r->tx_start + (RF_PREAMBLE + r->txlen * 8) * r->bit_ps;
+    r->heard++;
+    r->air_ps += r->tx_end - r->tx_start;
+    if(r->heard == 1)
+        r->first_heard = t;
+    r->last_heard = t;
+    r->tx_ch = r->rf_ch;
+    if(rfsrc_lost(r, r->tx_ch))
+        r->dropped++;
+    else if(r->recv)
+        r->recv(r->ctx, r, r->txbuf + r->addr_bytes, len, t);
+}
+
+//CS or CE raised at t: the transmitter stops with the packet half out, or
+//before it has started, and tx_end says so
+static void rfsrc_abort(struct sim_rfsrc *r, uint64_t t)
+{
+    if(!r->heard || t >= r->tx_end)
+        return;
+    r->aborted++;
+    r->air_ps -= r->tx_end - (t > r->tx_start ? t : r->tx_start);
+    r->tx_end = t;
+    if(r->cut)
+        r->cut(r->ctx, r, t);
+}
+
+//MCU clocking a receive channel: it samples after the rising edge
+static void rfsrc_shift(struct sim_rfsrc *r, struct sim_rfch *c, int rising, uint64_t t)
+{
+    if(c->bit < 0)
+        return;
+    if(rising){
+        if(c->bit == 0){
+            uint64_t lat = t - c->t_ready;
+            if(!c->sent || lat < c->lat_min)
+                c->lat_min = lat;
+            if(lat > c->lat_max)
+                c->lat_max = lat;
+            c->lat_sum += lat;
+        }
+        c->bit++;
+        if(c->bit == c->len * 8){
+            c->sent++;
+            c->last_read = t;
+            rfsrc_flush(r, c, t);
+        }
+    }else{
+        sim_pin_drive(r->m, t, RF_PORT_DATA, c->data_in, rfsrc_bit(c));
+    }
+}
+
+static void rfsrc_clock(struct sim_rfsrc *r, int rising, uint64_t t)
+{
+    struct sim_mcu *m = r->m;
+    uint8_t ctl = m->drive[RF_PORT_CTL];
+    int data = !!(m->drive[RF_PORT_DATA] & r->data_out);
+
+    if(ctl & RF_PIN_CS){
+        //configuration mode, RXEN is the last bit before CS drops
+        if(rising){
+            r->cfgbit = data;
+            if(r->cfgbits < RF_CONFIG_BYTES * 8){
+                if(data)
+                    r->in[r->cfgbits / 8] |= 0x80 >> (r->cfgbits % 8);
+                else
+                    r->in[r->cfgbits / 8] &= ~(0x80 >> (r->cfgbits % 8));
+            }
+            r->cfgbits++;
+        }
+        return;
+    }
+    if(!r->rx){
+        if(rising && (ctl & RF_PIN_CE) && r->txbits < (RF_MAX_ADDR + RF_MAX_PAYLOAD) * 8){
+            if(data)
+                r->txbuf[r->txbits / 8] |= 0x80 >> (r->txbits % 8);
+            else
+                r->txbuf[r->txbits / 8] &= ~(0x80 >> (r->txbits % 8));
+            r->txbits++;
+        }
+        return;
+    }
+    rfsrc_shift(r, &r->ch[0], rising, t);
+}
+
+//The configuration word is a shift register: the bytes shifted in replace
+//its last ones. DATA2_W, DATA1_W, ADDR2 (5), ADDR1 (5), ADDR_W/CRC,
+//RX2_EN/CM/RFDR_SB/..., RF_CH#/RXEN
+static void rfsrc_config(struct sim_rfsrc *r, int bytes)
+{
+    int from = RF_CONFIG_BYTES - bytes;
+    memcpy(r->cfg + from, r->in, bytes);
+    if(from == 0)
+        r->ch[1].width = r->cfg[0] / 8;
+    if(from <= 1)
+        r->ch[0].width = r->cfg[1] / 8;
+    if(r->ch[0].width > RF_MAX_PAYLOAD)
+        r->ch[0].width = RF_MAX_PAYLOAD;
+    if(r->ch[1].width > RF_MAX_PAYLOAD)
+        r->ch[1].width = RF_MAX_PAYLOAD;
+    if(from <= 2)
+        memcpy(r->ch[1].addr, &r->cfg[2], RF_MAX_ADDR);
+    if(from <= 7)
+        memcpy(r->ch[0].addr, &r->cfg[7], RF_MAX_ADDR);
+    if(from <= 12){
+        uint8_t w = r->cfg[12];
+        r->addr_bytes = (w >> 2) / 8;
+        if(r->addr_bytes > RF_MAX_ADDR)
+            r->addr_bytes = RF_MAX_ADDR;
+        r->crc_bits = !(w & 1) ? 0 : (w & 2) ? 16 : 8;
+    }
+    if(from <= 13 && !r->rx2 && (r->cfg[13] & 0x80)){
+        r->rx2 = 1;
+        sim_pin_drive(r->m, r->m->now, RF_PORT_DATA, r->ch[1].dr, 0);  // S2's pin
+    }else if(from <= 13){
+        r->rx2 = !!(r->cfg[13] & 0x80);
+    }
+    if(from <= 13)
+        r->bit_ps = (r->cfg[13] & 0x20) ? RF_BIT_PS : RF_BIT_PS_250K;
+    r->rf_ch = r->cfg[14] >> 1;
+}
+
+static void rfsrc_watch(void *ctx, struct sim_mcu *m, int port,
+                        uint8_t changed, uint8_t level, uint64_t t)
+{
+    struct sim_rfsrc *r = ctx;
+    int i;
+    (void)m;
+    if(port == RF_PORT_DATA && (changed & r->ch[0].clk))
+        rfsrc_clock(r, !!(level & r->ch[0].clk), t);
+    if(port == RF_PORT_DATA && (changed & r->ch[1].clk) && r->rx2)
+        rfsrc_shift(r, &r->ch[1], !!(level & r->ch[1].clk), t);
+    if(port != RF_PORT_CTL)
+        return;
+    if((changed & (RF_PIN_CS | RF_PIN_CE)) & level)
+        rfsrc_abort(r, t);
+    if((changed & RF_PIN_CS) && (level & RF_PIN_CS))
+        r->cfgbits = 0;
+    if((changed & RF_PIN_CS) && !(level & RF_PIN_CS)){
+        if(r->cfgbits % 8 == 0 && r->cfgbits && r->cfgbits <= RF_CONFIG_BYTES * 8)
+            rfsrc_config(r, r->cfgbits / 8);
+        r->rx = r->cfgbit;
+        r->cfg[RF_CONFIG_BYTES - 1] = (r->cfg[RF_CONFIG_BYTES - 1] & ~1) | r->rx;
+        for(i=0; i<2 && !r->rx; i++){
+            //switching to TX drops an unread packet
+            if(r->ch[i].bit >= 0)
+                r->ch[i].missed++;
+            rfsrc_flush(r, &r->ch[i], t);
+        }
+    }
+    if((changed & RF_PIN_CE) && !r->rx){
+        if(level & RF_PIN_CE)
+            r->txbits = 0;
+        else
+            rfsrc_transmit(r, t);
+    }
+    //the receiver settles from here, or once the last packet is out
+    if(!rfsrc_listening(r))
+        r->rx_since = RF_NONE;
+    else if(r->rx_since == RF_NONE)
+        r->rx_since = t > r->tx_end ? t : r->tx_end;
+}
+
+void sim_rfsrc_init(struct sim_rfsrc *r, struct sim_mcu *m, int usi)
+{
+    memset(r, 0, sizeof(*r));
+    r->m = m;
+    r->ch[0].data_in = usi ? RF_PIN_SDI : RF_PIN_DATA;
+    r->ch[0].clk = RF_PIN_CLK1;
+    r->ch[0].dr = usi ? RF_PIN_DR1_USI : RF_PIN_DR1;
+    r->ch[1].data_in = RF_PIN_DOUT2;
+    r->ch[1].clk = RF_PIN_CLK2;
+    r->ch[1].dr = RF_PIN_DR2;
+    r->ch[0].bit = r->ch[1].bit = -1;
+    r->data_out = usi ? RF_PIN_SDO : RF_PIN_DATA;
+    r->rnd = 0x9E3779B9;
+    r->addr_bytes = 2;          // until the MCU configures it
+    r->crc_bits = 16;
+    r->bit_ps = RF_BIT_PS;
+    r->rx_since = RF_NONE;
+    r->rf_ch = 64;
+    r->jam_ch = -1;
+    r->ch[0].addr[3] = r->ch[0].addr[4] = 0x42;
+    sim_pin_drive(m, 0, RF_PORT_DATA, r->ch[0].dr, 0);
+    sim_pin_watch(m, rfsrc_watch, r);
+}
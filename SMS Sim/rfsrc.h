@@ -0,0 +1,149 @@
+/******************************************************************************
+ * Stub ShockBurst transceiver on the RF-24G data channel 1 pins
+ *
+ * Follows the configuration the MCU shifts in with CS high: the full word
+ * sets the address and CRC widths, both channels' addresses and payload
+ * widths, RX2_EN and the data rate, the last byte the RF channel and RXEN, a
+ * single bit just RXEN.
+ * In TX mode it collects the address and payload clocked in while CE is high;
+ * when CE drops it adds the ShockBurst CRC and, RF_TX_SETTLE later, the packet
+ * is on the air for its preamble, address, payload and CRC bits at the data
+ * rate; `recv` gets it as CE drops. Raising CS (a configuration write, a
+ * channel change or RX) or CE again before the packet is out aborts it:
+ * `cut` is told, and it ends there, or never starts. In RX mode a packet on the RF channel with
+ * channel 1's address and a good CRC raises DR1 at its end and is shifted out
+ * on DATA, MSB first, one bit per CLK1 pulse from the MCU, then DR1 drops.
+ * With RX2_EN a packet 8MHz up with channel 2's address does the same on DR2,
+ * DOUT2 and CLK2. A packet is lost, as it would be on the air, unless the MCU
+ * had been listening (RX, CE high, CS low) since RF_RX_SETTLE before it
+ * started and the last one is read. Just enough of the RF-24G to exercise
+ * getBuffer(), putBuffer() and the open/ack exchange; air.h carries packets
+ * between several of them.
+ ******************************************************************************/
+#ifndef SIM_RFSRC_H
+#define SIM_RFSRC_H
+
+#include "sim.h"
+
+//RF-24G wiring used by rf24g_2.c
+#define RF_PORT_DATA    1
+#define RF_PIN_DATA     0x10    // P1.4
+#define RF_PIN_CLK1     0x20    // P1.5
+#define RF_PIN_DR1      0x80    // P1.7
+#define RF_PORT_CTL     2
+#define RF_PIN_CE       0x40    // P2.6
+#define RF_PIN_CS       0x80    // P2.7
+
+//rf24g_2.c built with RF_24G_USI: DATA goes to SDO and SDI, DR1 moves
+#define RF_PIN_SDO      0x40    // P1.6
+#define RF_PIN_SDI      0x80    // P1.7
+#define RF_PIN_DR1_USI  0x10    // P1.4
+
+//rf24g_2.c built with RF_24G_RX2: data channel 2
+#define RF_PIN_CLK2     0x01    // P1.0
+#define RF_PIN_DR2      0x08    // P1.3
+#define RF_PIN_DOUT2    0x40    // P1.6
+
+#define RF_CONFIG_BYTES 15              // full configuration word
+#define RF_MAX_ADDR     5
+#define RF_MAX_PAYLOAD  32
+#define RF_MAX_CRC      2
+#define RF_BIT_PS       1000000ULL      // 1Mbps
+#define RF_BIT_PS_250K  4000000ULL      // 250kbps, RFDR_SB clear
+#define RF_PREAMBLE     8               // bits
+#define RF_TX_SETTLE    (195 * SIM_PS_PER_US)   // CE low to the preamble
+#define RF_RX_SETTLE    (202 * SIM_PS_PER_US)   // CE high in RX to listening
+#define RF_CH2_OFFSET   8               // channel 2 is 8MHz above channel 1
+
+struct sim_rfsrc;
+
+//a packet the MCU transmitted, t when CE dropped (tx_start and tx_end say
+//when it is on the air), or the next periodic packet to fill in
+typedef void (*sim_rf_fn)(void *ctx, struct sim_rfsrc *r, uint8_t *payload,
+                          int len, uint64_t t);
+//the one `recv` got last was aborted at t, its tx_end now; before tx_start
+//it never went on the air
+typedef void (*sim_rf_cut_fn)(void *ctx, struct sim_rfsrc *r, uint64_t t);
+
+//a receive channel, air to MCU
+struct sim_rfch {
+    uint8_t data_in;            // pin the RF-24G drives
+    uint8_t clk;                // pin the MCU clocks it out with
+    uint8_t dr;
+    int width;                  // payload, bytes
+    uint8_t addr[RF_MAX_ADDR];  // ADDRx_4..ADDRx_0 as in cfg
+    uint8_t payload[RF_MAX_PAYLOAD];
+    int len;
+    int bit;                    // next payload bit, -1 when DR is low
+    unsigned sent;              // packets read by the MCU
+    uint64_t last_read;         // when the last one was
+    unsigned missed;            // arrived while the MCU was not listening, or
+                                // not read before it switched to TX
+
+    //DR rising to the MCU's first clock edge, ps
+    uint64_t t_ready;
+    uint64_t lat_min, lat_max, lat_sum;
+};
+
+struct sim_rfsrc {
+    struct sim_mcu *m;
+    uint8_t data_out;           // pin the MCU drives
+    int rx;                     // RXEN of the last configuration
+    int rx2;                    // RX2_EN
+    int rf_ch;                  // RF_CH#, channel 1's frequency
+    int cfgbit;                 // last bit shifted in with CS high
+    int cfgbits;                // bits shifted in since CS went high
+    uint8_t in[RF_CONFIG_BYTES];    // and the bits themselves
+    uint8_t cfg[RF_CONFIG_BYTES];   // the configuration word they end up in
+    int addr_bytes;
+    int crc_bits;
+    uint64_t bit_ps;            // air time of a bit at RFDR_SB
+    uint64_t rx_since;          // listening, settled from RF_RX_SETTLE later
+    struct sim_rfch ch[2];      // data channels 1 and 2
+    unsigned loss;              // percent of packets lost on the air
+    int jam_ch;                 // RF channel losing jam percent more, -1 for none
+    unsigned jam;
+    uint32_t rnd;
+    void *ctx;
+
+    //MCU to air
+    uint8_t txbuf[RF_MAX_ADDR + RF_MAX_PAYLOAD + RF_MAX_CRC];
+    int txbits;
+    int txlen;                  // address, payload and CRC bytes of the last one
+    uint64_t tx_start, tx_end;  // and when it was on the air
+    sim_rf_fn recv;
+    sim_rf_cut_fn cut;
+    unsigned heard;             // packets the MCU transmitted
+    unsigned aborted;           // of those, cut short by CS or CE
+    uint64_t air_ps;            // and their time on the air
+    uint64_t first_heard, last_heard;
+    int tx_ch;                  // RF channel of the last one
+
+    unsigned dropped;           // lost on the air, either way
+    unsigned filtered;          // for another address or channel, no DR
+    unsigned crc_errors;        // for us but garbled, no DR
+
+    //periodic source; `next` may rewrite each packet before it goes out
+    uint64_t period;
+    int periodic_ch;
+    uint8_t periodic_addr[RF_MAX_ADDR];
+    uint8_t periodic[RF_MAX_PAYLOAD];
+    int periodic_len;
+    sim_rf_fn next;
+};
+
+void sim_rfsrc_init(struct sim_rfsrc *r, struct sim_mcu *m, int usi);
+//rf_ch is the RF channel, addr RF_MAX_ADDR bytes like a channel's `addr`; only
+//the low addr_bytes are compared
+void sim_rfsrc_send(struct sim_rfsrc *r, uint64_t t, int rf_ch, const uint8_t *addr,
+                    const uint8_t *payload, int len);
+//packet on the air as a transmitter clocked it, address, payload and CRC
+//bytes, that started at `start` and ends now, at t; the receiver checks it
+//against its own configuration. True if it raised DR.
+int sim_rfsrc_receive(struct sim_rfsrc *r, uint64_t t, uint64_t start, int rf_ch,
+                       const uint8_t *pkt, int len);
+uint16_t sim_rf_crc(const uint8_t *p, int n, int bits);
+void sim_rfsrc_periodic(struct sim_rfsrc *r, uint64_t first, uint64_t period,
+                        int rf_ch, const uint8_t *addr, const uint8_t *payload, int len);
+
+#endif
@@ -0,0 +1,1551 @@
+/******************************************************************************
+ * MSP430G2452 peripheral simulator - core
+ *
+ * Clock system, Timer_A2, USI, watchdog, port 1/2 and interrupt dispatch. Register
+ * writes made by the firmware land directly in m->mem; they are picked up at
+ * the start of the next access by comparing against m->shadow, which is when
+ * their side effects (pin levels, timer reconfiguration...) take place.
+ ******************************************************************************/
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <elf.h>
+#include <link.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sim.h"
+
+//register addresses (see msp430g2452.h)
+#define A_IE1       0x0000
+#define A_IFG1      0x0002
+#define A_BCSCTL3   0x0053
+#define A_DCOCTL    0x0056
+#define A_BCSCTL1   0x0057
+#define A_BCSCTL2   0x0058
+#define A_P1IN      0x0020
+#define A_P2IN      0x0028
+#define A_USICTL0   0x0078
+#define A_USICTL1   0x0079
+#define A_USICKCTL  0x007A
+#define A_USICNT    0x007B
+#define A_USISRL    0x007C
+#define A_USISRH    0x007D
+#define A_WDTCTL    0x0120
+#define A_FCTL1     0x0128
+#define A_FCTL2     0x012A
+#define A_FCTL3     0x012C
+#define A_TAIV      0x012E
+#define A_TACTL     0x0160
+#define A_TACCTL0   0x0162
+#define A_TACCTL1   0x0164
+#define A_TAR       0x0170
+#define A_TACCR0    0x0172
+#define A_TACCR1    0x0174
+#define A_INFO          0x1000          // info memory, segments D..A
+#define A_CALDCO_16MHZ  0x10F8
+#define A_CALBC1_16MHZ  0x10F9
+#define A_CALDCO_8MHZ   0x10FC
+#define A_CALBC1_8MHZ   0x10FD
+#define A_CALDCO_1MHZ   0x10FE
+#define A_CALBC1_1MHZ   0x10FF
+
+//offsets inside a port block
+#define P_IN    0
+#define P_OUT   1
+#define P_DIR   2
+#define P_IFG   3
+#define P_IES   4
+#define P_IE    5
+#define P_SEL   6
+#define P_REN   7
+
+#define SR_GIE      0x0008
+#define SR_CPUOFF   0x0010
+#define SR_OSCOFF   0x0020
+#define SR_SCG0     0x0040
+#define SR_SCG1     0x0080
+
+#define TA_CAP      0x0100
+#define TA_SCCI     0x0400
+#define TA_CCIE     0x0010
+#define TA_CCI      0x0008
+#define TA_OUT      0x0004
+#define TA_COV      0x0002
+#define TA_CCIFG    0x0001
+#define TA_TACLR    0x0004
+#define TA_TAIE     0x0002
+#define TA_TAIFG    0x0001
+
+#define BIT(n)      (1u << (n))
+
+#define USI_PE7     0x80
+#define USI_PE6     0x40
+#define USI_PE5     0x20
+#define USI_LSB     0x10
+#define USI_MST     0x08
+#define USI_OE      0x02
+#define USI_SWRST   0x01
+#define USI_CKPH    0x80
+#define USI_IE      0x10
+#define USI_IFG     0x01
+#define USI_CKPL    0x02
+#define USI_16B     0x40
+#define USI_IFGCC   0x20
+
+#define WDT_HOLD    0x0080
+#define WDT_TMSEL   0x0010
+#define WDT_CNTCL   0x0008
+#define WDT_SSEL    0x0004
+
+#define FC_WRT      0x0040
+#define FC_ERASE    0x0002
+#define FC_FSSEL    0x00C0
+#define FC_FN       0x003F
+#define FC_LOCK     0x0010
+#define FC_ACCVIFG  0x0004
+
+static __thread struct sim_mcu *sim_cur;
+
+static void sim_advance(struct sim_mcu *m, uint32_t cycles);
+static void sim_pins(struct sim_mcu *m, int port);
+static void sim_irq(struct sim_mcu *m);
+static void wdt_config(struct sim_mcu *m);
+
+static inline void spin_reset(struct sim_mcu *m)
+{
+    m->spin_n = m->spin_p = m->spin_match = 0;
+}
+
+/*******************************************************************************
+ * register file helpers
+ ******************************************************************************/
+static inline uint16_t rd16(struct sim_mcu *m, unsigned a)
+{
+    return *(uint16_t *)&m->mem[a];
+}
+
+static inline void wr16(struct sim_mcu *m, unsigned a, uint16_t v)
+{
+    *(uint16_t *)&m->mem[a] = v;
+}
+
+static inline uint16_t sh16(struct sim_mcu *m, unsigned a)
+{
+    return *(uint16_t *)&m->shadow[a];
+}
+
+static inline unsigned port_base(int port)
+{
+    return port == 1 ? A_P1IN : A_P2IN;
+}
+
+double sim_seconds(uint64_t ps)
+{
+    return (double)ps / SIM_PS_PER_S;
+}
+
+/*******************************************************************************
+ * clock system
+ *
+ * The DCO follows the datasheet trend: ~35% per RSEL step and ~8% per DCO step,
+ * with MODx mixing DCO and DCO+1 over 32 DCOCLK cycles. It is anchored so the
+ * factory 1MHz calibration gives exactly 1MHz; the 8 and 16MHz ones are the
+ * nearest settings to their frequency, a few hundred ppm off like the real
+ * thing.
+ ******************************************************************************/
+#define SIM_CAL_BC1_1MHZ    0x86
+#define SIM_CAL_DCO_1MHZ    0xB5
+#define SIM_CAL_BC1_8MHZ    0x8D
+#define SIM_CAL_DCO_8MHZ    0xAC
+#define SIM_CAL_BC1_16MHZ   0x8F
+#define SIM_CAL_DCO_16MHZ   0xD3
+
+//relative frequency of one RSEL/DCO tap
+static double dco_tap(int rsel, int dco)
+{
+    double f = 1;
+    int k;
+    for(k=0; k<rsel; k++) f *= 1.35;
+    for(k=0; k<dco; k++) f *= 1.08;
+    return f;
+}
+
+//relative average frequency, MOD of 32 cycles at DCO+1 (none at DCO=7)
+static double dco_rel(uint8_t bcs1, uint8_t dcoctl)
+{
+    int rsel = bcs1 & 0x0F;
+    int dco = dcoctl >> 5;
+    int mod = dco == 7 ? 0 : dcoctl & 0x1F;
+    double fa = dco_tap(rsel, dco);
+    double fb = dco_tap(rsel, dco + 1);
+    return 32 * fa * fb / (mod * fa + (32 - mod) * fb);
+}
+
+static double dco_hz(uint8_t bcs1, uint8_t dcoctl)
+{
+    return 1e6 * dco_rel(bcs1, dcoctl) / dco_rel(SIM_CAL_BC1_1MHZ, SIM_CAL_DCO_1MHZ);
+}
+
+static uint64_t period_ps(uint32_t hz)
+{
+    return hz ? (SIM_PS_PER_S + hz/2) / hz : 0;
+}
+
+static void sim_clocks(struct sim_mcu *m)
+{
+    uint8_t bcs1 = m->mem[A_BCSCTL1];
+    uint8_t bcs2 = m->mem[A_BCSCTL2];
+    uint8_t bcs3 = m->mem[A_BCSCTL3];
+    uint32_t dco = (uint32_t)(dco_hz(bcs1, m->mem[A_DCOCTL]) * (1 + m->dco_ppm / 1e6) + 0.5);
+    uint32_t lf = (bcs3 & 0x30) == 0x20 ? 12000 : 32768;   // VLO or watch crystal
+    uint16_t ctl;
+    uint32_t src;
+
+    m->aclk_hz = lf >> ((bcs1 >> 4) & 3);
+    m->mclk_hz = ((bcs2 >> 6) == 3 ? lf : dco) >> ((bcs2 >> 4) & 3);
+    m->smclk_hz = ((bcs2 & 0x08) ? lf : dco) >> ((bcs2 >> 1) & 3);
+    m->dco_ps = period_ps(m->mclk_hz);
+
+    //Timer_A clock
+    ctl = rd16(m, A_TACTL);
+    switch((ctl >> 8) & 3){
+    case 1:  src = (m->sr & SR_OSCOFF) ? 0 : m->aclk_hz; break;
+    case 2:  src = (m->sr & SR_SCG1) ? 0 : m->smclk_hz; break;
+    default: src = 0; break;        // TACLK/INCLK are not bonded out
+    }
+    if(((ctl >> 4) & 3) == 0)
+        src = 0;                    // stop mode
+    src >>= (ctl >> 6) & 3;
+    if(!src){
+        m->ta_period = 0;
+    }else if(m->ta_period != period_ps(src)){
+        m->ta_period = period_ps(src);
+        m->ta_next = m->now + m->ta_period;
+    }
+    wdt_config(m);      // SMCLK or ACLK may have gone off under it
+}
+
+/*******************************************************************************
+ * Timer_A
+ ******************************************************************************/
+static void ta_output(struct sim_mcu *m, int ch, int eq0)
+{
+    uint16_t ctl = rd16(m, A_TACCTL0 + 2*ch);
+    uint8_t *o = &m->ta_out[ch];
+    switch((ctl >> 5) & 7){
+    case 0: break;
+    case 1: *o = 1; break;
+    case 2: *o = eq0 ? 0 : !*o; break;
+    case 3: *o = eq0 ? 0 : 1; break;
+    case 4: *o = !*o; break;
+    case 5: *o = 0; break;
+    case 6: *o = eq0 ? 1 : !*o; break;
+    case 7: *o = eq0 ? 1 : 0; break;
+    }
+}
+
+static void ta_compare(struct sim_mcu *m, uint16_t tar)
+{
+    int ch;
+    for(ch=0; ch<2; ch++){
+        uint16_t ctl = rd16(m, A_TACCTL0 + 2*ch);
+        if(ctl & TA_CAP)
+            continue;
+        if(tar == rd16(m, A_TACCR0 + 2*ch)){
+            //SCCI latches CCIxA (P1.1, P1.2) as it is on EQUx
+            ctl &= ~TA_SCCI;
+            if(!(ctl & 0x3000) && sim_pin_level(m, 1, ch ? BIT(2) : BIT(1)))
+                ctl |= TA_SCCI;
+            wr16(m, A_TACCTL0 + 2*ch, ctl | TA_CCIFG);
+            ta_output(m, ch, 0);
+        }
+    }
+    //second half of the set/reset style modes happens on EQU0
+    if(tar == rd16(m, A_TACCR0) && !(rd16(m, A_TACCTL1) & TA_CAP)){
+        uint16_t mode = (rd16(m, A_TACCTL1) >> 5) & 7;
+        if(mode == 2 || mode == 3 || mode == 6 || mode == 7){
+            m->ta_out[1] = (mode >= 6);
+        }
+    }
+}
+
+static void ta_tick(struct sim_mcu *m)
+{
+    uint16_t ctl = rd16(m, A_TACTL);
+    uint16_t tar = rd16(m, A_TAR);
+    uint16_t ccr0 = rd16(m, A_TACCR0);
+    int wrap = 0;
+
+    switch((ctl >> 4) & 3){
+    case 1:     // up
+        if(tar >= ccr0){
+            tar = 0;
+            wrap = 1;
+        }else{
+            tar++;
+        }
+        break;
+    case 2:     // continuous
+        tar++;
+        wrap = (tar == 0);
+        break;
+    case 3:     // up/down
+        if(m->ta_up){
+            if(tar >= ccr0){
+                m->ta_up = 0;
+                tar--;
+            }else{
+                tar++;
+            }
+        }else{
+            if(tar == 0){
+                m->ta_up = 1;
+                tar++;
+            }else{
+                tar--;
+                wrap = (tar == 0);
+            }
+        }
+        break;
+    }
+    wr16(m, A_TAR, tar);
+    *(uint16_t *)&m->shadow[A_TAR] = tar;       // not a firmware write
+    if(wrap)
+        wr16(m, A_TACTL, rd16(m, A_TACTL) | TA_TAIFG);
+    ta_compare(m, tar);
+}
+
+//timer clocks from now on that only count TAR up: no compare, no wrap. Up/down
+//mode goes one clock at a time.
+static uint32_t ta_quiet(struct sim_mcu *m)
+{
+    uint16_t tar = rd16(m, A_TAR);
+    uint32_t n, d;
+    int ch;
+    switch((rd16(m, A_TACTL) >> 4) & 3){
+    case 1:
+        n = rd16(m, A_TACCR0) > tar ? rd16(m, A_TACCR0) - tar : 0;
+        break;
+    case 2:
+        n = 0x10000 - tar;
+        break;
+    default:
+        return 0;
+    }
+    for(ch=0; ch<2; ch++){
+        if(rd16(m, A_TACCTL0 + 2*ch) & TA_CAP)
+            continue;
+        d = (uint16_t)(rd16(m, A_TACCR0 + 2*ch) - tar);
+        if(d && d < n)
+            n = d;
+    }
+    return n ? n - 1 : 0;
+}
+
+//input edge on CCIxA (P1.1 for CCR0, P1.2 for CCR1) or a software capture
+static void ta_capture(struct sim_mcu *m, int ch, int level)
+{
+    uint16_t ctl = rd16(m, A_TACCTL0 + 2*ch);
+    uint16_t cm = ctl >> 14;
+    if(!(ctl & TA_CAP))
+        return;
+    if(!((cm & 1) && level) && !((cm & 2) && !level))
+        return;
+    wr16(m, A_TACCR0 + 2*ch, rd16(m, A_TAR));
+    if(ctl & TA_CCIFG)
+        ctl |= TA_COV;
+    wr16(m, A_TACCTL0 + 2*ch, ctl | TA_CCIFG);
+}
+
+/*******************************************************************************
+ * USI
+ *
+ * SPI master mode: USICNT counts bits, SCLK runs from the selected clock only
+ * while the count is non zero. One edge of each bit captures SDI, the other
+ * shifts the register and puts the new MSB (or LSB) on SDO; USICKPH picks
+ * which comes first. Hardware updates go to mem and shadow alike so they are
+ * not mistaken for firmware writes.
+ ******************************************************************************/
+static void usi_set(struct sim_mcu *m, unsigned a, uint8_t v)
+{
+    m->mem[a] = m->shadow[a] = v;
+}
+
+static int usi_out(struct sim_mcu *m)
+{
+    uint16_t sr = rd16(m, A_USISRL);
+    if(m->mem[A_USICTL0] & USI_LSB)
+        return sr & 1;
+    if(m->mem[A_USICNT] & USI_16B)
+        return !!(sr & 0x8000);
+    return !!(sr & 0x80);
+}
+
+static void usi_shift(struct sim_mcu *m)
+{
+    int wide = !!(m->mem[A_USICNT] & USI_16B);
+    uint16_t mask = wide ? 0xFFFF : 0x00FF;
+    uint16_t sr = rd16(m, A_USISRL);
+    uint16_t v = sr & mask;
+    if(m->mem[A_USICTL0] & USI_LSB)
+        v = (v >> 1) | (m->usi_latch ? (wide ? 0x8000 : 0x80) : 0);
+    else
+        v = ((v << 1) | m->usi_latch) & mask;
+    sr = (sr & ~mask) | v;
+    usi_set(m, A_USISRL, sr & 0xFF);
+    usi_set(m, A_USISRH, sr >> 8);
+}
+
+//firmware wrote USICNT: start clocking out that many bits
+static void usi_start(struct sim_mcu *m)
+{
+    uint8_t ckctl = m->mem[A_USICKCTL];
+    uint32_t src;
+    if(!(m->mem[A_USICNT] & USI_IFGCC))
+        m->mem[A_USICTL1] &= ~USI_IFG;
+    m->usi_half = 0;
+    if((m->mem[A_USICTL0] & (USI_SWRST|USI_MST)) != USI_MST || !(m->mem[A_USICNT] & 0x1F))
+        return;
+    switch((ckctl >> 2) & 7){
+    case 1:  src = m->aclk_hz; break;
+    case 2:
+    case 3:  src = m->smclk_hz; break;
+    default: src = 0; break;        // SCLK/TA clocks and USISWCLK not modelled
+    }
+    src >>= (ckctl >> 5) & 7;
+    if(!src){
+        m->fault = "USI clock source not supported";
+        return;
+    }
+    m->usi_half = period_ps(src) / 2;
+    m->usi_next = m->now + m->usi_half;
+}
+
+static void usi_edge(struct sim_mcu *m)
+{
+    int ckph = !!(m->mem[A_USICTL1] & USI_CKPH);
+    int first;
+    uint8_t cnt;
+    m->usi_sclk = !m->usi_sclk;
+    first = (m->usi_sclk != !!(m->mem[A_USICKCTL] & USI_CKPL));
+    if(first == ckph)
+        m->usi_latch = sim_pin_level(m, 1, BIT(7));     // capture edge
+    if(!first)
+        usi_shift(m);
+    if(first != ckph)
+        m->usi_sdo = usi_out(m);                        // change edge
+    if(first){
+        m->usi_next += m->usi_half;
+        return;
+    }
+    //bit done
+    cnt = m->mem[A_USICNT];
+    cnt = (cnt & 0xE0) | (((cnt & 0x1F) - 1) & 0x1F);
+    usi_set(m, A_USICNT, cnt);
+    if(cnt & 0x1F){
+        m->usi_next += m->usi_half;
+    }else{
+        usi_set(m, A_USICTL1, m->mem[A_USICTL1] | USI_IFG);
+        m->usi_half = 0;
+    }
+}
+
+/*******************************************************************************
+ * watchdog
+ ******************************************************************************/
+//in interval mode the count stops with its clock, SMCLK in LPM3, and goes on
+//from there when it is back; watchdog mode keeps its clock on (fail-safe)
+static void wdt_config(struct sim_mcu *m)
+{
+    static const uint32_t div[4] = { 32768, 8192, 512, 64 };
+    uint16_t ctl = rd16(m, A_WDTCTL);
+    uint32_t src = (ctl & WDT_SSEL) ? m->aclk_hz : m->smclk_hz;
+    int off = (ctl & WDT_TMSEL) && (m->sr & ((ctl & WDT_SSEL) ? SR_OSCOFF : SR_SCG1));
+    uint64_t period;
+    if(ctl & WDT_HOLD || !src){
+        m->wdt_period = 0;
+        return;
+    }
+    period = period_ps(src) * div[ctl & 3];
+    if(ctl & WDT_CNTCL || !m->wdt_next){
+        m->wdt_next = m->now + period;
+        m->wdt_stopped = 0;
+    }
+    if(off && !m->wdt_stopped){
+        m->wdt_left = m->wdt_next > m->now ? m->wdt_next - m->now : 0;
+        m->wdt_stopped = 1;
+    }else if(!off && m->wdt_stopped){
+        m->wdt_next = m->now + m->wdt_left;
+        m->wdt_stopped = 0;
+    }
+    m->wdt_period = off ? 0 : period;
+}
+
+static void wdt_expire(struct sim_mcu *m)
+{
+    if(rd16(m, A_WDTCTL) & WDT_TMSEL){
+        m->mem[A_IFG1] |= 0x01;     // WDTIFG
+        m->wdt_next += m->wdt_period;
+    }else{
+        m->fault = "watchdog reset";
+        m->wdt_period = 0;
+    }
+}
+
+/*******************************************************************************
+ * flash controller, info memory only
+ ******************************************************************************/
+#define FLASH_SEGMENT       64          // info segment bytes
+#define FLASH_WORD_FTG      30          // tWord, timing generator clocks
+#define FLASH_ERASE_FTG     4819        // tSeg Erase
+
+//MCLK cycles the CPU is held for n timing generator clocks
+static uint32_t flash_cycles(struct sim_mcu *m, uint32_t n)
+{
+    uint16_t ctl = rd16(m, A_FCTL2);
+    uint32_t src = (ctl & FC_FSSEL) == 0 ? m->aclk_hz
+                 : (ctl & FC_FSSEL) == 0x40 ? m->mclk_hz : m->smclk_hz;
+    if(!src)
+        return 0;
+    return (uint64_t)n * ((ctl & FC_FN) + 1) * m->mclk_hz / src;
+}
+
+//a write to info memory with ERASE set, the dummy one that starts an erase
+static void flash_access(struct sim_mcu *m, unsigned addr)
+{
+    if(addr >= A_INFO && (rd16(m, A_FCTL1) & FC_ERASE))
+        m->flash_erase = addr;
+}
+
+//Info memory only changes the way FCTL1 and FCTL3 let the firmware: a
+//segment erase, or bits programmed from 1 to 0; anything else is put back
+//and sets ACCVIFG. Returns the cycles the CPU waits for it, as it does
+//running from flash.
+static uint32_t flash_sync(struct sim_mcu *m)
+{
+    uint8_t *info = m->mem + A_INFO;
+    uint16_t ctl1 = rd16(m, A_FCTL1), ctl3 = rd16(m, A_FCTL3);
+    uint32_t ftg = 0;
+    unsigned a;
+    if(m->flash_erase){
+        a = (m->flash_erase - A_INFO) & ~(FLASH_SEGMENT - 1);
+        m->flash_erase = 0;
+        if(ctl3 & FC_LOCK){
+            wr16(m, A_FCTL3, ctl3 | FC_ACCVIFG);
+        }else{
+            memset(m->info + a, 0xFF, FLASH_SEGMENT);
+            memcpy(info + a, m->info + a, FLASH_SEGMENT);
+            wr16(m, A_FCTL1, ctl1 & ~FC_ERASE);
+            ftg += FLASH_ERASE_FTG;
+        }
+    }
+    if(!memcmp(info, m->info, sizeof(m->info)))
+        return flash_cycles(m, ftg);
+    for(a=0; a<sizeof(m->info); a+=2){
+        if(info[a] == m->info[a] && info[a+1] == m->info[a+1])
+            continue;
+        if((ctl1 & FC_WRT) && !(ctl3 & FC_LOCK)){
+            m->info[a] &= info[a];
+            m->info[a+1] &= info[a+1];
+            ftg += FLASH_WORD_FTG;
+        }else{
+            wr16(m, A_FCTL3, rd16(m, A_FCTL3) | FC_ACCVIFG);
+        }
+        info[a] = m->info[a];
+        info[a+1] = m->info[a+1];
+    }
+    return flash_cycles(m, ftg);
+}
+
+/*******************************************************************************
+ * write detection
+ ******************************************************************************/
+static void sim_sync(struct sim_mcu *m)
+{
+    uint16_t v;
+    unsigned a;
+    int ch;
+
+    //watchdog: a written value still carries the password in the high byte
+    v = rd16(m, A_WDTCTL);
+    if((v >> 8) != 0x69){
+        if((v >> 8) != 0x5A){
+            m->fault = "WDTCTL password violation";
+        }
+        wr16(m, A_WDTCTL, 0x6900 | (v & 0xF7));
+        if(v & WDT_CNTCL)
+            m->wdt_next = 0;
+        wdt_config(m);
+    }
+
+    //flash controller: FWKEY to write, FRKEY when read back
+    for(a=A_FCTL1; a<=A_FCTL3; a+=2){
+        v = rd16(m, a);
+        if((v >> 8) != 0x96){
+            if((v >> 8) != 0xA5)
+                m->fault = "FCTL password violation";
+            wr16(m, a, 0x9600 | (v & 0xFF));
+        }
+    }
+
+    if(m->mem[A_DCOCTL] != m->shadow[A_DCOCTL]
+            || m->mem[A_BCSCTL1] != m->shadow[A_BCSCTL1]
+            || m->mem[A_BCSCTL2] != m->shadow[A_BCSCTL2]
+            || m->mem[A_BCSCTL3] != m->shadow[A_BCSCTL3]
+            || rd16(m, A_TACTL) != sh16(m, A_TACTL)){
+        v = rd16(m, A_TACTL);
+        if(v & TA_TACLR){
+            wr16(m, A_TAR, 0);
+            wr16(m, A_TACTL, v & ~TA_TACLR);
+            m->ta_up = 1;
+        }
+        sim_clocks(m);
+        wdt_config(m);
+    }
+
+    for(ch=0; ch<2; ch++){
+        unsigned a = A_TACCTL0 + 2*ch;
+        v = rd16(m, a);
+        //output mode 0 drives the OUT bit straight through
+        if(((v >> 5) & 7) == 0)
+            m->ta_out[ch] = !!(v & TA_OUT);
+        //CCIS toggled between GND and VCC: software capture
+        if((v & 0x2000) && (sh16(m, a) & 0x2000)
+                && ((v ^ sh16(m, a)) & 0x1000)){
+            ta_capture(m, ch, !!(v & 0x1000));
+        }
+    }
+
+    //USI: a new shift register value shows its first bit right away in
+    //USICKPH mode, writing the bit count starts the transfer
+    if(m->mem[A_USICTL0] & USI_SWRST){
+        m->usi_half = 0;
+        m->usi_sclk = !!(m->mem[A_USICKCTL] & USI_CKPL);
+    }
+    if(m->mem[A_USISRL] != m->shadow[A_USISRL] || m->mem[A_USISRH] != m->shadow[A_USISRH]){
+        if(m->mem[A_USICTL1] & USI_CKPH)
+            m->usi_sdo = usi_out(m);
+    }
+    if(m->mem[A_USICNT] != m->shadow[A_USICNT])
+        usi_start(m);
+
+    sim_pins(m, 1);
+    sim_pins(m, 2);
+    if(memcmp(m->shadow, m->mem, sizeof(m->shadow))){
+        spin_reset(m);              // the firmware wrote something
+        memcpy(m->shadow, m->mem, sizeof(m->shadow));
+    }
+}
+
+/*******************************************************************************
+ * pins
+ ******************************************************************************/
+static void sim_pins(struct sim_mcu *m, int port)
+{
+    unsigned b = port_base(port);
+    uint8_t dir = m->mem[b+P_DIR];
+    uint8_t sel = m->mem[b+P_SEL];
+    uint8_t drive = m->mem[b+P_OUT];
+    uint8_t lvl, changed, edges;
+    int i;
+
+    if(port == 1){
+        //TA0.0 on P1.1/P1.5, TA0.1 on P1.2/P1.6
+        uint8_t ta = (m->ta_out[0] ? (BIT(1)|BIT(5)) : 0)
+                   | (m->ta_out[1] ? (BIT(2)|BIT(6)) : 0);
+        drive = (drive & ~sel) | (ta & sel);
+        //USI pins are taken over by USIPEx, whatever PxSEL/PxDIR say
+        if(m->mem[A_USICTL0] & USI_PE5 && m->mem[A_USICTL0] & USI_MST){
+            dir |= BIT(5);
+            drive = (drive & ~BIT(5)) | (m->usi_sclk ? BIT(5) : 0);
+        }
+        if(m->mem[A_USICTL0] & USI_PE6){
+            if(m->mem[A_USICTL0] & USI_OE){
+                dir |= BIT(6);
+                drive = (drive & ~BIT(6)) | (m->usi_sdo ? BIT(6) : 0);
+            }else{
+                dir &= ~BIT(6);
+            }
+        }
+        if(m->mem[A_USICTL0] & USI_PE7)
+            dir &= ~BIT(7);
+    }
+    lvl = (dir & drive) | (~dir & m->ext[port]);
+
+    changed = lvl ^ m->pinlvl[port];
+    if(changed){
+        //port interrupts see the pin when it is not given to a peripheral;
+        //PxIES set means falling edge
+        edges = changed & ~sel & (lvl ^ m->mem[b+P_IES]);
+        m->mem[b+P_IFG] |= edges;
+        if(port == 1 && (changed & sel & ~dir & BIT(1)))
+            ta_capture(m, 0, !!(lvl & BIT(1)));
+        if(port == 1 && (changed & sel & ~dir & BIT(2)))
+            ta_capture(m, 1, !!(lvl & BIT(2)));
+        m->pinlvl[port] = lvl;
+    }
+
+    changed = (drive & dir) ^ m->drive[port];
+    if(changed){
+        m->drive[port] = drive & dir;
+        for(i=0; i<m->nwatch; i++)
+            m->watch[i].fn(m->watch[i].ctx, m, port, changed, m->drive[port], m->now);
+    }
+}
+
+int sim_pin_level(struct sim_mcu *m, int port, uint8_t bit)
+{
+    return !!(m->pinlvl[port] & bit);
+}
+
+void sim_pin_watch(struct sim_mcu *m, sim_watch_fn fn, void *ctx)
+{
+    if(m->nwatch < SIM_MAX_WATCH){
+        m->watch[m->nwatch].fn = fn;
+        m->watch[m->nwatch].ctx = ctx;
+        m->nwatch++;
+    }
+}
+
+//edge queue is a binary min-heap on (t, seq)
+static int edge_before(const struct sim_edge *a, const struct sim_edge *b)
+{
+    return a->t < b->t || (a->t == b->t && a->seq < b->seq);
+}
+
+static void edge_push(struct sim_mcu *m, struct sim_edge e)
+{
+    int i;
+    if(m->nedges >= SIM_MAX_EDGES){
+        m->fault = "input edge queue overflow";
+        return;
+    }
+    if(e.t < m->now)
+        e.t = m->now;
+    e.seq = m->edge_seq++;
+    i = m->nedges++;
+    while(i > 0 && edge_before(&e, &m->edges[(i-1)/2])){
+        m->edges[i] = m->edges[(i-1)/2];
+        i = (i-1)/2;
+    }
+    m->edges[i] = e;
+}
+
+void sim_pin_drive(struct sim_mcu *m, uint64_t t, int port, uint8_t bit, int level)
+{
+    struct sim_edge e;
+    memset(&e, 0, sizeof(e));
+    e.t = t;
+    e.port = port;
+    e.bit = bit;
+    e.level = !!level;
+    edge_push(m, e);
+}
+
+//call fn at time t, in time order with the pin changes
+void sim_at(struct sim_mcu *m, uint64_t t, sim_event_fn fn, void *ctx)
+{
+    struct sim_edge e;
+    memset(&e, 0, sizeof(e));
+    e.t = t;
+    e.fn = fn;
+    e.ctx = ctx;
+    edge_push(m, e);
+}
+
+static void edge_pop(struct sim_mcu *m)
+{
+    struct sim_edge last = m->edges[--m->nedges];
+    int i = 0;
+    for(;;){
+        int c = 2*i + 1;
+        if(c >= m->nedges)
+            break;
+        if(c+1 < m->nedges && edge_before(&m->edges[c+1], &m->edges[c]))
+            c++;
+        if(!edge_before(&m->edges[c], &last))
+            break;
+        m->edges[i] = m->edges[c];
+        i = c;
+    }
+    m->edges[i] = last;
+}
+
+static void edge_apply(struct sim_mcu *m)
+{
+    struct sim_edge e = m->edges[0];
+    edge_pop(m);
+    spin_reset(m);
+    if(e.fn){
+        e.fn(e.ctx, m, e.t);
+        return;
+    }
+    if(e.level)
+        m->ext[e.port] |= e.bit;
+    else
+        m->ext[e.port] &= ~e.bit;
+    sim_pins(m, e.port);
+}
+
+/*******************************************************************************
+ * power
+ ******************************************************************************/
+static int sim_mode(struct sim_mcu *m)
+{
+    if(!(m->sr & SR_CPUOFF))
+        return 0;
+    if(m->sr & SR_OSCOFF)
+        return 5;
+    if((m->sr & (SR_SCG1|SR_SCG0)) == (SR_SCG1|SR_SCG0))
+        return 4;
+    if(m->sr & SR_SCG1)
+        return 3;
+    if(m->sr & SR_SCG0)
+        return 2;
+    return 1;
+}
+
+static double mode_ua(struct sim_mcu *m, int mode)
+{
+    double mhz = m->mclk_hz / 1e6;
+    switch(mode){
+    case 0:  return SIM_UA_ACTIVE_1MHZ * mhz;
+    case 1:  return SIM_UA_LPM0_1MHZ * mhz;
+    case 2:  return SIM_UA_LPM1_1MHZ * mhz;
+    case 3:  return SIM_UA_LPM2;
+    case 4:  return SIM_UA_LPM3;
+    default: return SIM_UA_LPM4;
+    }
+}
+
+static void sim_power(struct sim_mcu *m, uint64_t ps)
+{
+    int mode = sim_mode(m);
+    m->mode_ps[mode] += ps;
+    m->charge_pc += mode_ua(m, mode) * ps * 1e-6;     // uA * ps = 1e-6 pC
+}
+
+//average supply current since reset
+double sim_current_ua(struct sim_mcu *m)
+{
+    return m->now ? m->charge_pc / m->now * 1e6 : 0;
+}
+
+void sim_power_print(struct sim_mcu *m, FILE *f)
+{
+    static const char *name[SIM_MODES] = { "active", "LPM0", "LPM1", "LPM2", "LPM3", "LPM4" };
+    int i;
+    fprintf(f, "power: %.2f uA average", sim_current_ua(m));
+    for(i=0; i<SIM_MODES; i++){
+        if(m->mode_ps[i])
+            fprintf(f, ", %s %.2f%%", name[i], m->now ? 100.0 * m->mode_ps[i] / m->now : 0);
+    }
+    fprintf(f, "\n");
+}
+
+/*******************************************************************************
+ * time
+ ******************************************************************************/
+static void sim_yield(struct sim_mcu *m)
+{
+    swapcontext(&m->ctx, &m->host);
+}
+
+//run every peripheral event up to time t; timer clocks that only count are
+//added up in one go
+static void sim_until(struct sim_mcu *m, uint64_t t)
+{
+    if(t > m->now)
+        sim_power(m, t - m->now);
+    for(;;){
+        uint64_t next = t, quiet;
+        int what = 0;
+        if(m->nedges && m->edges[0].t <= next){
+            next = m->edges[0].t;
+            what = 1;
+        }
+        if(m->ta_period && m->ta_next < next){
+            next = m->ta_next;
+            what = 2;
+        }
+        if(m->wdt_period && m->wdt_next < next){
+            next = m->wdt_next;
+            what = 3;
+        }
+        if(m->usi_half && m->usi_next < next){
+            next = m->usi_next;
+            what = 4;
+        }
+        if(!what)
+            break;
+        m->now = next;
+        switch(what){
+        case 1:
+            edge_apply(m);
+            break;
+        case 2:
+            if((quiet = ta_quiet(m)) != 0){
+                //up to the clock before the next compare, or anything else
+                uint64_t end = t, clocks;
+                if(m->nedges && m->edges[0].t < end)
+                    end = m->edges[0].t;
+                if(m->wdt_period && m->wdt_next < end)
+                    end = m->wdt_next;
+                if(m->usi_half && m->usi_next < end)
+                    end = m->usi_next;
+                clocks = end > m->ta_next ? (end - m->ta_next - 1) / m->ta_period + 1 : 1;
+                if(clocks < quiet)
+                    quiet = clocks;
+                wr16(m, A_TAR, rd16(m, A_TAR) + quiet);
+                *(uint16_t *)&m->shadow[A_TAR] = rd16(m, A_TAR);
+                m->ta_next += quiet * m->ta_period;
+                break;
+            }
+            m->ta_next += m->ta_period;
+            ta_tick(m);
+            sim_pins(m, 1);
+            spin_reset(m);
+            break;
+        case 3:
+            wdt_expire(m);
+            spin_reset(m);
+            break;
+        case 4:
+            usi_edge(m);
+            sim_pins(m, 1);
+            spin_reset(m);
+            break;
+        }
+    }
+    m->now = t;
+}
+
+//time of the next thing that can change anything, UINT64_MAX for none
+static uint64_t sim_next(struct sim_mcu *m)
+{
+    uint64_t t = UINT64_MAX;
+    if(m->nedges)
+        t = m->edges[0].t;
+    if(m->ta_period && m->ta_next + ta_quiet(m) * m->ta_period < t)
+        t = m->ta_next + ta_quiet(m) * m->ta_period;
+    if(m->wdt_period && m->wdt_next < t)
+        t = m->wdt_next;
+    if(m->usi_half && m->usi_next < t)
+        t = m->usi_next;
+    return t;
+}
+
+static void sim_advance(struct sim_mcu *m, uint32_t cycles)
+{
+    sim_sync(m);
+    cycles += flash_sync(m);
+    m->cycles += cycles;
+    sim_until(m, m->now + cycles * m->dco_ps);
+    if(m->fault)
+        m->halted = 1;
+    while(m->now >= m->until || m->halted)
+        sim_yield(m);
+}
+
+/*******************************************************************************
+ * interrupts
+ ******************************************************************************/
+static int irq_pending(struct sim_mcu *m)
+{
+    if((m->mem[A_IE1] & m->mem[A_IFG1] & 0x01) && (rd16(m, A_WDTCTL) & WDT_TMSEL))
+        return 10;      // WDT_VECTOR
+    if((rd16(m, A_TACCTL0) & (TA_CCIE|TA_CCIFG)) == (TA_CCIE|TA_CCIFG))
+        return 9;       // TIMER0_A0_VECTOR
+    if((rd16(m, A_TACCTL1) & (TA_CCIE|TA_CCIFG)) == (TA_CCIE|TA_CCIFG)
+            || (rd16(m, A_TACTL) & (TA_TAIE|TA_TAIFG)) == (TA_TAIE|TA_TAIFG))
+        return 8;       // TIMER0_A1_VECTOR
+    if((m->mem[A_USICTL1] & (USI_IE|USI_IFG)) == (USI_IE|USI_IFG))
+        return 4;       // USI_VECTOR
+    if(m->mem[A_P2IN+P_IFG] & m->mem[A_P2IN+P_IE])
+        return 3;       // PORT2_VECTOR
+    if(m->mem[A_P1IN+P_IFG] & m->mem[A_P1IN+P_IE])
+        return 2;       // PORT1_VECTOR
+    return 0;
+}
+
+static void sim_irq(struct sim_mcu *m)
+{
+    while((m->sr & SR_GIE) && !m->halted){
+        int vec = irq_pending(m);
+        const struct sim_vector *v;
+        uint16_t saved;
+        uint16_t *outer;
+        if(!vec)
+            return;
+        for(v=m->vectors; v && v->isr; v++){
+            if(v->vector == vec)
+                break;
+        }
+        if(!v || !v->isr){
+            m->fault = "interrupt with no handler";
+            m->halted = 1;
+            sim_yield(m);
+            return;
+        }
+        spin_reset(m);
+        //single source flags are cleared on acceptance
+        if(vec == 10)
+            m->mem[A_IFG1] &= ~0x01;
+        if(vec == 9)
+            wr16(m, A_TACCTL0, rd16(m, A_TACCTL0) & ~TA_CCIFG);
+
+        saved = m->sr;
+        outer = m->sr_saved;
+        m->sr_saved = &saved;
+        m->sr &= SR_SCG0;
+        sim_clocks(m);
+        m->irq_depth++;
+        sim_advance(m, SIM_IRQ_CYCLES);
+        v->isr();
+        sim_advance(m, SIM_RETI_CYCLES);
+        m->irq_depth--;
+        m->sr = saved;
+        m->sr_saved = outer;
+        sim_clocks(m);
+    }
+}
+
+/*******************************************************************************
+ * firmware entry points (called through msp430g2452.h)
+ ******************************************************************************/
+static struct sim_mcu *sim_running(void)
+{
+    struct sim_mcu *m = sim_cur;
+    if(!m){
+        fprintf(stderr, "sim: register access outside of a running MCU\n");
+        abort();
+    }
+    return m;
+}
+
+static void sim_access(struct sim_mcu *m, uint32_t cycles)
+{
+    sim_advance(m, cycles);
+    sim_irq(m);
+}
+
+//one &ADDR operand: SIM_ACCESS_CYCLES +/- 1
+static uint32_t access_cost(struct sim_mcu *m)
+{
+    uint32_t x = m->jitter;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    m->jitter = x;
+    return SIM_ACCESS_CYCLES - 1 + x % 3;
+}
+
+//polling loops: key stands for one register read and the value it got, a
+//call or a return, which cost `cycles`, 0 for a read: access_cost(). Once
+//the last 3 * spin_p of them (SIM_SPIN_MIN at least) came round the same way
+//with nothing happening in between (spin_reset()), they will until the next
+//event, so the turns that end before it are only time. They are charged one
+//by one with the access costs they would have had, so skipping them changes
+//nothing but how long the simulation takes.
+static void sim_spin(struct sim_mcu *m, uint64_t key, uint32_t cycles)
+{
+    unsigned n = m->spin_n, p = m->spin_p, i, reads = 0;
+    uint64_t next, fixed = 0, total = 0;
+    if(!m->skip_spins)
+        return;
+    if(p && m->spin_key[(n - p) % SIM_SPIN_LOG] == key){
+        m->spin_match++;
+    }else{
+        m->spin_p = m->spin_match = 0;
+        for(p=1; p<=n && p<=SIM_SPIN_MAX; p++){
+            if(m->spin_key[(n - p) % SIM_SPIN_LOG] == key){
+                m->spin_p = p;
+                m->spin_match = 1;
+                break;
+            }
+        }
+    }
+    m->spin_key[n % SIM_SPIN_LOG] = key;
+    m->spin_cycles[n % SIM_SPIN_LOG] = cycles;
+    m->spin_n = ++n;
+    p = m->spin_p;
+    if(!p || m->spin_match < 2 * p || m->spin_match < SIM_SPIN_MIN)
+        return;
+    spin_reset(m);
+    next = sim_next(m);
+    if(next > m->until)
+        next = m->until;
+    if(next <= m->now)
+        return;
+    for(i=1; i<=p; i++){
+        fixed += m->spin_cycles[(n - i) % SIM_SPIN_LOG];
+        reads += !m->spin_cycles[(n - i) % SIM_SPIN_LOG];
+    }
+    if(!reads){
+        total = (next - m->now - 1) / (fixed * m->dco_ps) * fixed;
+    }else{
+        for(;;){
+            uint32_t jitter = m->jitter;
+            uint64_t turn = fixed;
+            for(i=0; i<reads; i++)
+                turn += access_cost(m);
+            if(m->now + (total + turn) * m->dco_ps >= next){
+                m->jitter = jitter;
+                break;
+            }
+            total += turn;
+        }
+    }
+    if(total){
+        m->cycles += total;
+        m->spun_ps += total * m->dco_ps;
+        sim_until(m, m->now + total * m->dco_ps);
+    }
+}
+
+volatile uint8_t *sim_reg8(unsigned addr)
+{
+    struct sim_mcu *m = sim_running();
+    sim_access(m, access_cost(m));
+    //inputs are sampled at the time of the read
+    m->mem[A_P1IN] = m->shadow[A_P1IN] = m->pinlvl[1];
+    m->mem[A_P2IN] = m->shadow[A_P2IN] = m->pinlvl[2];
+    flash_access(m, addr);
+    sim_spin(m, (1ULL << 60) | (uint64_t)m->mem[addr] << 32 | addr, 0);
+    return &m->mem[addr];
+}
+
+volatile uint16_t *sim_reg16(unsigned addr)
+{
+    struct sim_mcu *m = sim_running();
+    sim_access(m, access_cost(m));
+    if(addr == A_TAIV){
+        //reading TAIV returns and clears the highest pending CCR1/TAIFG flag
+        uint16_t iv = 0;
+        if((rd16(m, A_TACCTL1) & (TA_CCIE|TA_CCIFG)) == (TA_CCIE|TA_CCIFG)){
+            iv = 2;
+            wr16(m, A_TACCTL1, rd16(m, A_TACCTL1) & ~TA_CCIFG);
+        }else if((rd16(m, A_TACTL) & (TA_TAIE|TA_TAIFG)) == (TA_TAIE|TA_TAIFG)){
+            iv = 10;
+            wr16(m, A_TACTL, rd16(m, A_TACTL) & ~TA_TAIFG);
+        }
+        wr16(m, A_TAIV, iv);
+    }
+    if((addr == A_TACCTL0 || addr == A_TACCTL1)){
+        //CCI follows the selected capture input
+        int ch = (addr - A_TACCTL0) / 2;
+        uint16_t v = rd16(m, addr) & ~TA_CCI;
+        if(sim_pin_level(m, 1, ch ? BIT(2) : BIT(1)))
+            v |= TA_CCI;
+        wr16(m, addr, v);
+        *(uint16_t *)&m->shadow[addr] = v;
+    }
+    flash_access(m, addr);
+    sim_spin(m, (2ULL << 60) | (uint64_t)rd16(m, addr) << 32 | addr, 0);
+    return (volatile uint16_t *)&m->mem[addr];
+}
+
+void sim_sr_bis(unsigned bits)
+{
+    struct sim_mcu *m = sim_running();
+    m->sr |= bits;
+    sim_clocks(m);
+    sim_access(m, 1);
+    //low power mode: nothing but peripherals run until an ISR clears CPUOFF,
+    //from one thing that can happen to the next
+    spin_reset(m);
+    while(m->sr & SR_CPUOFF){
+        uint64_t cycles = m->cycles;
+        uint64_t t = sim_next(m);
+        t = t < m->until ? t + 1 : m->until;
+        sim_until(m, t > m->now ? t : m->now + 1);
+        m->cycles = cycles;
+        sim_advance(m, 0);
+        sim_irq(m);
+    }
+}
+
+void sim_sr_bic(unsigned bits)
+{
+    struct sim_mcu *m = sim_running();
+    m->sr &= ~bits;
+    sim_clocks(m);
+    sim_access(m, 1);
+    sim_spin(m, (3ULL << 60) | bits, 1);
+}
+
+void sim_sr_bis_on_exit(unsigned bits)
+{
+    struct sim_mcu *m = sim_running();
+    if(m->sr_saved)
+        *m->sr_saved |= bits;
+}
+
+void sim_sr_bic_on_exit(unsigned bits)
+{
+    struct sim_mcu *m = sim_running();
+    if(m->sr_saved)
+        *m->sr_saved &= ~bits;
+}
+
+unsigned sim_sr_get(void)
+{
+    return sim_running()->sr;
+}
+
+void sim_delay_cycles(unsigned long n)
+{
+    struct sim_mcu *m = sim_running();
+    spin_reset(m);                  // counted, see sim.h
+    while(n > SIM_INSN_MAX_CYCLES){ // interrupts are taken on time
+        sim_access(m, SIM_INSN_MAX_CYCLES);
+        n -= SIM_INSN_MAX_CYCLES;
+    }
+    sim_access(m, n);
+}
+
+/*******************************************************************************
+ * profiling (-finstrument-functions in the firmware image)
+ ******************************************************************************/
+void __cyg_profile_func_enter(void *fn, void *site)
+    __attribute__((no_instrument_function));
+void __cyg_profile_func_exit(void *fn, void *site)
+    __attribute__((no_instrument_function));
+
+void __cyg_profile_func_enter(void *fn, void *site)
+{
+    struct sim_mcu *m = sim_cur;
+    int i;
+    (void)site;
+    if(!m)
+        return;
+    if(m->prof_depth < SIM_PROF_DEPTH){
+        struct sim_frame *f = &m->stack_prof[m->prof_depth];
+        f->fn = fn;
+        f->start = m->cycles;
+        f->child = 0;
+    }
+    m->prof_depth++;
+    sim_access(m, SIM_CALL_CYCLES);
+    sim_spin(m, (4ULL << 60) ^ (uintptr_t)fn, SIM_CALL_CYCLES);
+    for(i=0; i<m->ncharges; i++)
+        if(fn == m->charge[i].fn)
+            sim_delay_cycles(m->charge[i].cycles);
+}
+
+static struct sim_prof *prof_slot(struct sim_mcu *m, void *fn)
+{
+    unsigned h = ((uintptr_t)fn >> 2) % SIM_PROF_SLOTS;
+    unsigned i;
+    for(i=0; i<SIM_PROF_SLOTS; i++){
+        struct sim_prof *p = &m->prof[(h+i) % SIM_PROF_SLOTS];
+        if(p->fn == fn || !p->fn){
+            p->fn = fn;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+void __cyg_profile_func_exit(void *fn, void *site)
+{
+    struct sim_mcu *m = sim_cur;
+    struct sim_frame *f;
+    struct sim_prof *p;
+    uint64_t total;
+    (void)site;
+    if(!m || m->prof_depth == 0)
+        return;
+    sim_access(m, SIM_RET_CYCLES);
+    sim_spin(m, (5ULL << 60) ^ (uintptr_t)fn, SIM_RET_CYCLES);
+    m->prof_depth--;
+    if(m->prof_depth >= SIM_PROF_DEPTH)
+        return;
+    f = &m->stack_prof[m->prof_depth];
+    total = m->cycles - f->start;
+    if(m->prof_depth > 0 && m->prof_depth <= SIM_PROF_DEPTH)
+        m->stack_prof[m->prof_depth-1].child += total;
+    p = prof_slot(m, f->fn);
+    if(!p)
+        return;
+    if(!p->calls || total < p->min)
+        p->min = total;
+    if(total > p->max)
+        p->max = total;
+    p->calls++;
+    p->total += total;
+    p->self += total - f->child;
+}
+
+//The image's .symtab, for the static functions dladdr() can't name: the
+//dynamic symbol table only has the exported ones.
+static int sym_cmp(const void *a, const void *b)
+{
+    const struct sim_sym *x = a, *y = b;
+    return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+static void sim_syms_load(struct sim_mcu *m, const char *image)
+{
+    struct link_map *lm;
+    Elf64_Ehdr *eh;
+    Elf64_Shdr *sh;
+    Elf64_Sym *sym;
+    char *buf = NULL;
+    long n;
+    FILE *in;
+    int i, j, k;
+    if(dlinfo(m->image, RTLD_DI_LINKMAP, &lm) || !(in = fopen(image, "rb")))
+        return;
+    if(fseek(in, 0, SEEK_END) == 0 && (n = ftell(in)) > (long)sizeof(*eh)
+            && (buf = malloc(n)) && fseek(in, 0, SEEK_SET) == 0 && fread(buf, 1, n, in) == (size_t)n){
+        eh = (Elf64_Ehdr *)buf;
+        sh = (Elf64_Shdr *)(buf + eh->e_shoff);
+        for(i=0; i<eh->e_shnum && eh->e_shoff + (i+1) * sizeof(*sh) <= (unsigned long)n; i++){
+            if(sh[i].sh_type != SHT_SYMTAB || sh[i].sh_link >= eh->e_shnum)
+                continue;
+            sym = (Elf64_Sym *)(buf + sh[i].sh_offset);
+            k = sh[i].sh_size / sizeof(*sym);
+            m->syms = calloc(k, sizeof(*m->syms));
+            m->symstr = malloc(sh[sh[i].sh_link].sh_size);
+            if(!m->syms || !m->symstr)
+                break;
+            memcpy(m->symstr, buf + sh[sh[i].sh_link].sh_offset, sh[sh[i].sh_link].sh_size);
+            for(j=0; j<k; j++){
+                if(ELF64_ST_TYPE(sym[j].st_info) != STT_FUNC || !sym[j].st_value)
+                    continue;
+                m->syms[m->nsyms].addr = lm->l_addr + sym[j].st_value;
+                m->syms[m->nsyms].size = sym[j].st_size;
+                m->syms[m->nsyms].name = m->symstr + sym[j].st_name;
+                m->nsyms++;
+            }
+            qsort(m->syms, m->nsyms, sizeof(*m->syms), sym_cmp);
+            break;
+        }
+    }
+    free(buf);
+    fclose(in);
+}
+
+static const char *prof_name(struct sim_mcu *m, void *fn)
+{
+    Dl_info info;
+    uintptr_t a = (uintptr_t)fn;
+    int lo = 0, hi = m->nsyms - 1, mid;
+    while(lo <= hi){
+        mid = (lo + hi) / 2;
+        if(a < m->syms[mid].addr)
+            hi = mid - 1;
+        else if(a >= m->syms[mid].addr + m->syms[mid].size)
+            lo = mid + 1;
+        else
+            return m->syms[mid].name;
+    }
+    if(dladdr(fn, &info) && info.dli_sname)
+        return info.dli_sname;
+    return "?";
+}
+
+static int prof_cmp(const void *a, const void *b)
+{
+    const struct sim_prof *x = a, *y = b;
+    return (y->total > x->total) - (y->total < x->total);
+}
+
+const struct sim_prof *sim_prof_find(struct sim_mcu *m, const char *fn)
+{
+    void *addr = sim_mcu_sym(m, fn);
+    int i;
+    for(i=0; !addr && i<m->nsyms; i++){
+        if(!strcmp(m->syms[i].name, fn))
+            addr = (void *)m->syms[i].addr;
+    }
+    for(i=0; addr && i<SIM_PROF_SLOTS; i++){
+        if(m->prof[i].fn == addr)
+            return &m->prof[i];
+    }
+    return NULL;
+}
+
+void sim_prof_print(struct sim_mcu *m, FILE *f)
+{
+    struct sim_prof sorted[SIM_PROF_SLOTS];
+    int i;
+    memcpy(sorted, m->prof, sizeof(sorted));
+    qsort(sorted, SIM_PROF_SLOTS, sizeof(sorted[0]), prof_cmp);
+    fprintf(f, "cycles are %s\n", SIM_LOWER_BOUND);
+    fprintf(f, "%-20s %8s %12s %12s %10s %10s %10s\n",
+            "function", "calls", "cycles", "self", "min", "avg", "max");
+    for(i=0; i<SIM_PROF_SLOTS; i++){
+        struct sim_prof *p = &sorted[i];
+        if(!p->calls)
+            continue;
+        fprintf(f, "%-20s %8u %12llu %12llu %10llu %10llu %10llu\n",
+                prof_name(m, p->fn), p->calls,
+                (unsigned long long)p->total, (unsigned long long)p->self,
+                (unsigned long long)p->min,
+                (unsigned long long)(p->total / p->calls),
+                (unsigned long long)p->max);
+    }
+}
+
+/*******************************************************************************
+ * MCU lifetime
+ ******************************************************************************/
+static void sim_reset(struct sim_mcu *m)
+{
+    memset(m->mem, 0, sizeof(m->mem));
+    //PUC values
+    m->mem[A_DCOCTL] = 0x60;
+    m->mem[A_BCSCTL1] = 0x87;
+    m->mem[A_P1IN+P_SEL] = 0;
+    m->mem[A_P2IN+P_SEL] = 0xC0;
+    wr16(m, A_WDTCTL, 0x6900);
+    wr16(m, A_FCTL1, 0x9600);
+    wr16(m, A_FCTL2, 0x9642);
+    wr16(m, A_FCTL3, 0x9658);
+    m->mem[A_IFG1] = 0x04;
+    m->mem[A_USICTL0] = USI_SWRST;
+    m->mem[A_USICTL1] = USI_IFG;
+    //info memory, erased but for the calibration constants
+    memset(m->mem + A_INFO, 0xFF, SIM_MEM_SIZE - A_INFO);
+    m->mem[A_CALDCO_1MHZ] = SIM_CAL_DCO_1MHZ;
+    m->mem[A_CALBC1_1MHZ] = SIM_CAL_BC1_1MHZ;
+    m->mem[A_CALDCO_8MHZ] = SIM_CAL_DCO_8MHZ;
+    m->mem[A_CALBC1_8MHZ] = SIM_CAL_BC1_8MHZ;
+    m->mem[A_CALDCO_16MHZ] = SIM_CAL_DCO_16MHZ;
+    m->mem[A_CALBC1_16MHZ] = SIM_CAL_BC1_16MHZ;
+    memcpy(m->shadow, m->mem, sizeof(m->shadow));
+    memcpy(m->info, m->mem + A_INFO, sizeof(m->info));
+
+    m->ext[1] = m->ext[2] = 0xFF;
+    m->pinlvl[1] = m->pinlvl[2] = 0xFF;
+    m->ta_up = 1;
+    m->sr = 0;
+    m->jitter = 0x2545F491;
+    sim_clocks(m);
+    wdt_config(m);
+}
+
+static void sim_trampoline(void)
+{
+    struct sim_mcu *m = sim_cur;
+    m->entry();
+    m->halted = 1;
+    sim_yield(m);
+}
+
+//dlopen() hands out one copy of an image's globals however often it is
+//opened, so a second MCU running it gets a private copy of the file
+static void *sim_load(const char *image)
+{
+    char tmp[] = "/tmp/simXXXXXX.so";
+    char buf[65536];
+    void *h = dlopen(image, RTLD_NOW | RTLD_LOCAL | RTLD_NOLOAD);
+    FILE *in;
+    ssize_t n;
+    int fd;
+    if(!h)
+        return dlopen(image, RTLD_NOW | RTLD_LOCAL);
+    dlclose(h);
+    if(!(in = fopen(image, "rb")) || (fd = mkstemps(tmp, 3)) < 0){
+        if(in)
+            fclose(in);
+        return NULL;
+    }
+    while((n = fread(buf, 1, sizeof(buf), in)) > 0 && write(fd, buf, n) == n)
+        ;
+    fclose(in);
+    close(fd);
+    h = dlopen(tmp, RTLD_NOW | RTLD_LOCAL);
+    unlink(tmp);
+    return h;
+}
+
+struct sim_mcu *sim_mcu_new(const char *name, const char *image)
+{
+    struct sim_mcu *m = calloc(1, sizeof(*m));
+    if(!m)
+        return NULL;
+    m->name = name;
+    m->image = sim_load(image);
+    if(!m->image){
+        const char *e = dlerror();
+        fprintf(stderr, "sim: %s\n", e ? e : image);
+        free(m);
+        return NULL;
+    }
+    m->vectors = dlsym(m->image, "sim_vectors");
+    m->entry = (void (*)(void))dlsym(m->image, "main");
+    sim_syms_load(m, image);
+    m->stack = malloc(SIM_STACK_SIZE);
+    m->skip_spins = 1;
+    sim_reset(m);
+    return m;
+}
+
+void sim_mcu_free(struct sim_mcu *m)
+{
+    if(!m)
+        return;
+    dlclose(m->image);
+    free(m->syms);
+    free(m->symstr);
+    free(m->stack);
+    free(m);
+}
+
+void *sim_mcu_sym(struct sim_mcu *m, const char *sym)
+{
+    return dlsym(m->image, sym);
+}
+
+void sim_mcu_info(struct sim_mcu *m, unsigned addr, uint8_t v)
+{
+    m->mem[addr] = m->info[addr - A_INFO] = v;
+}
+
+//n words from addr, least significant byte first like the MSP430's
+void sim_mcu_info32(struct sim_mcu *m, unsigned addr, const uint32_t *v, int n)
+{
+    int i, k;
+    for(i=0; i<n; i++)
+        for(k=0; k<4; k++)
+            sim_mcu_info(m, addr + 4*i + k, v[i] >> 8*k);
+}
+
+int sim_mcu_charge(struct sim_mcu *m, const char *fn, unsigned long cycles)
+{
+    void *p = dlsym(m->image, fn);
+    if(!p || m->ncharges == SIM_CHARGES)
+        return 0;
+    m->charge[m->ncharges].fn = p;
+    m->charge[m->ncharges++].cycles = cycles;
+    return 1;
+}
+
+void sim_mcu_entry(struct sim_mcu *m, void (*fn)(void))
+{
+    m->entry = fn;
+}
+
+//run the firmware until simulated time `until`; returns nonzero once it stops
+int sim_mcu_run(struct sim_mcu *m, uint64_t until)
+{
+    struct sim_mcu *prev = sim_cur;
+    if(m->halted)
+        return 1;
+    if(!m->started){
+        getcontext(&m->ctx);
+        m->ctx.uc_stack.ss_sp = m->stack;
+        m->ctx.uc_stack.ss_size = SIM_STACK_SIZE;
+        m->ctx.uc_link = NULL;
+        makecontext(&m->ctx, sim_trampoline, 0);
+        m->started = 1;
+    }
+    m->until = until;
+    sim_cur = m;
+    swapcontext(&m->host, &m->ctx);
+    sim_cur = prev;
+    return m->halted;
+}
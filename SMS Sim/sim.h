@@ -0,0 +1,253 @@
+/******************************************************************************
+ * MSP430G2452 peripheral simulator
+ *
+ * A firmware image (SMS Server or SMS Client, built as a shared object against
+ * the msp430g2452.h in this directory) runs natively on the host inside its
+ * own coroutine. Every special function register access goes through
+ * sim_reg8()/sim_reg16(), which charges cycles to the MCU, advances the clock
+ * system, Timer_A, the watchdog and the port pins to the new time and then
+ * dispatches any pending, enabled interrupt by calling the firmware ISR.
+ *
+ * Time is kept in picoseconds so several MCUs with different clocks can share
+ * one timeline. Only peripheral accesses and call/return are charged; the
+ * arithmetic in between is not, so cycle counts are a lower bound that is
+ * dominated by I/O - which is where TX_Byte, putBuffer and getBuffer spend
+ * their time anyway. It also means a loop that neither touches a register
+ * nor calls a function never lets time pass; poll through a function (as
+ * mainLoop()/getc() do) or sleep in a low power mode instead.
+ *
+ * Nothing is simulated that cannot change anything: Timer_A clocks that only
+ * count TAR up are added in one go, a low power mode sleeps straight to the
+ * next pin change, compare, wrap, watchdog interval or USI edge, and so does
+ * a polling loop (skip_spins) once it has gone round the same way three
+ * times, and over SIM_SPIN_MIN register reads, calls and returns, reading the
+ * same values and writing nothing. That last one is a guess: a loop that also
+ * counts its own turns in RAM would run long. The firmware has none of those;
+ * the MAC rounds are not seen at all, see SIM_CHARGES. Clear
+ * skip_spins to run every turn (smssim -F, -p), e.g. for the per-function
+ * profile, which only sees the calls that ran.
+ ******************************************************************************/
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <ucontext.h>
+
+#define SIM_PS_PER_S            1000000000000ULL
+#define SIM_PS_PER_MS           1000000000ULL
+#define SIM_PS_PER_US           1000000ULL
+
+//cycle costs charged by the simulator (MSP430x2xx family guide, Format I/II).
+//An &ADDR operand costs about 3 cycles; each access is charged 2, 3 or 4 from
+//a fixed pseudo-random sequence so code that polls the free running TAR (e.g.
+//the `while (CCR0 != TAR)` in TX_Byte) cannot phase-lock against the timer
+//clock the way a constant cost would make it.
+#define SIM_ACCESS_CYCLES       3       // mean cost of one &ADDR operand
+#define SIM_CALL_CYCLES         5       // call #func
+#define SIM_RET_CYCLES          3       // ret
+#define SIM_IRQ_CYCLES          6       // interrupt acceptance
+#define SIM_RETI_CYCLES         5       // reti
+#define SIM_INSN_MAX_CYCLES     6       // longest instruction, an interrupt waits that at most
+
+//Arithmetic is free to the simulator, which is right for the firmware but
+//for a function that works on its own for a long time, touching no register
+//and calling nothing. sim_mcu_charge() charges such a function a fixed cost
+//on every call, an estimate the tools choose. They charge speck64(), whose
+//27 rounds are all arithmetic, SIM_SPECK64_CYCLES: 151 cycles a round,
+//counted with the timings above over the LLVM MSP430 backend's code for
+//mac.c. Hand written it would take about 52, cl430's code is somewhere in
+//between.
+#define SIM_CHARGES             4
+#define SIM_SPECK64_CYCLES      4077    // 27 * 151
+
+//what the benches print under cycle counts and the times made of them
+#define SIM_LOWER_BOUND         "lower bounds: only register accesses, calls and returns " \
+                                "are charged, not the instructions between; speck64() is " \
+                                "an estimate, 4077 cycles a call"
+
+//supply current by operating mode, MSP430G2x31 datasheet typicals at 3V. The
+//modes that keep the DCO running scale with MCLK from the 1MHz figure; LPM3
+//assumes ACLK from the VLO.
+#define SIM_MODES               6       // active, LPM0..LPM4
+#define SIM_UA_ACTIVE_1MHZ      300.0
+#define SIM_UA_LPM0_1MHZ        65.0
+#define SIM_UA_LPM1_1MHZ        65.0
+#define SIM_UA_LPM2             22.0
+#define SIM_UA_LPM3             0.6
+#define SIM_UA_LPM4             0.1
+
+#define SIM_MEM_SIZE            0x1100  // peripherals + info memory
+#define SIM_MAX_EDGES           1024
+#define SIM_MAX_WATCH           4
+#define SIM_PROF_SLOTS          64
+#define SIM_PROF_DEPTH          32
+#define SIM_SPIN_LOG            64      // register reads, calls... kept to find a loop in
+#define SIM_SPIN_MAX            32      // longest loop found, in those
+#define SIM_SPIN_MIN            16      // and the least that have to repeat
+#define SIM_STACK_SIZE          (256*1024)
+
+struct sim_mcu;
+
+//one entry per `#pragma vector`, generated from the firmware sources
+struct sim_vector {
+    int vector;
+    void (*isr)(void);
+};
+
+typedef void (*sim_event_fn)(void *ctx, struct sim_mcu *m, uint64_t t);
+
+//scheduled change of an externally driven input pin, or a callback
+struct sim_edge {
+    uint64_t t;
+    uint32_t seq;           // keeps edges with the same time in order
+    uint8_t port;           // 1 or 2
+    uint8_t bit;
+    uint8_t level;
+    sim_event_fn fn;        // instead of a pin change when set
+    void *ctx;
+};
+
+//notified whenever the level the MCU drives onto a port changes
+typedef void (*sim_watch_fn)(void *ctx, struct sim_mcu *m, int port,
+                             uint8_t changed, uint8_t level, uint64_t t);
+
+struct sim_prof {
+    void *fn;
+    uint32_t calls;
+    uint64_t total;         // inclusive cycles
+    uint64_t self;          // exclusive cycles
+    uint64_t min;
+    uint64_t max;
+};
+
+struct sim_sym {
+    uintptr_t addr;
+    uint64_t size;
+    const char *name;
+};
+
+struct sim_frame {
+    void *fn;
+    uint64_t start;
+    uint64_t child;
+};
+
+struct sim_mcu {
+    const char *name;
+    void *image;                        // dlopen() handle
+    const struct sim_vector *vectors;
+    void (*entry)(void);
+
+    //peripheral file and info memory, addressed like the real part
+    uint8_t mem[SIM_MEM_SIZE] __attribute__((aligned(2)));
+    uint8_t shadow[0x200];              // last seen SFR values for write detection
+    uint8_t info[0x100];                // info memory as programmed, see flash_sync()
+    unsigned flash_erase;               // address an erase was started at, or 0
+
+    //time
+    uint64_t now;                       // ps
+    uint64_t cycles;                    // MCLK cycles
+    uint32_t jitter;                    // xorshift state for access costs
+    uint32_t mclk_hz, smclk_hz, aclk_hz;
+    uint64_t dco_ps;                    // DCO period
+    int dco_ppm;                        // this part's DCO off the calibrated figure
+    uint64_t mode_ps[SIM_MODES];        // time spent active and in each LPM
+    double charge_pc;                   // supply charge drawn so far, pC
+
+    //status register
+    uint16_t sr;
+    uint16_t *sr_saved;                 // SR pushed by the ISR being serviced
+    int irq_depth;
+
+    //Timer_A
+    uint64_t ta_next;                   // time of the next timer clock edge
+    uint64_t ta_period;                 // 0 when the timer is stopped
+    int ta_up;                          // direction in up/down mode
+    uint8_t ta_out[2];                  // output unit latches
+
+    //USI, SPI master only
+    uint64_t usi_next;                  // time of the next SCLK edge
+    uint64_t usi_half;                  // half an SCLK period, 0 when idle
+    uint8_t usi_sclk;
+    uint8_t usi_sdo;
+    uint8_t usi_latch;                  // SDI sampled on the capture edge
+
+    //watchdog
+    uint64_t wdt_next;
+    uint64_t wdt_period;                // 0 when held or its clock is off
+    uint64_t wdt_left;                  // to wdt_next when its clock went off
+    int wdt_stopped;
+
+    //pins
+    uint8_t ext[3];                     // level driven from outside, by port
+    uint8_t drive[3];                   // level driven by the MCU, by port
+    uint8_t pinlvl[3];                  // resolved pin level, by port
+    struct sim_edge edges[SIM_MAX_EDGES];
+    int nedges;
+    uint32_t edge_seq;
+    struct {
+        sim_watch_fn fn;
+        void *ctx;
+    } watch[SIM_MAX_WATCH];
+    int nwatch;
+
+    //polling loops, see sim_spin()
+    int skip_spins;                     // 1 from sim_mcu_new()
+    uint64_t spin_key[SIM_SPIN_LOG];
+    uint32_t spin_cycles[SIM_SPIN_LOG];
+    unsigned spin_n;                    // entries since anything happened
+    unsigned spin_p;                    // period they seem to repeat with
+    unsigned spin_match;                // entries that did
+    uint64_t spun_ps;                   // skipped
+
+    //execution
+    ucontext_t ctx;
+    ucontext_t host;
+    void *stack;
+    uint64_t until;
+    int started;
+    int halted;
+    const char *fault;
+
+    //profiling
+    struct sim_prof prof[SIM_PROF_SLOTS];
+    struct sim_frame stack_prof[SIM_PROF_DEPTH];
+    int prof_depth;
+    struct {
+        void *fn;
+        unsigned long cycles;           // charged on every call
+    } charge[SIM_CHARGES];
+    int ncharges;
+    struct sim_sym *syms;               // functions in the image's .symtab, by address
+    int nsyms;
+    char *symstr;
+};
+
+struct sim_mcu *sim_mcu_new(const char *name, const char *image);
+void sim_mcu_free(struct sim_mcu *m);
+void *sim_mcu_sym(struct sim_mcu *m, const char *sym);
+void sim_mcu_info(struct sim_mcu *m, unsigned addr, uint8_t v);     // programmed before the run
+void sim_mcu_info32(struct sim_mcu *m, unsigned addr, const uint32_t *v, int n);
+//the door key the tools program at INFO_KEY_ADDR (door.h), and smssim's stub
+//peers use
+#define SIM_DOOR_KEY            { 0x7A3C9E15, 0xC4D2610B, 0x5E8F37A1, 0x92B04DE6 }
+//fn in the image costs cycles more each call, see SIM_CHARGES; 0 if it has none
+int sim_mcu_charge(struct sim_mcu *m, const char *fn, unsigned long cycles);
+void sim_mcu_entry(struct sim_mcu *m, void (*fn)(void));
+int sim_mcu_run(struct sim_mcu *m, uint64_t until);
+
+void sim_pin_drive(struct sim_mcu *m, uint64_t t, int port, uint8_t bit, int level);
+int sim_pin_level(struct sim_mcu *m, int port, uint8_t bit);
+void sim_pin_watch(struct sim_mcu *m, sim_watch_fn fn, void *ctx);
+void sim_at(struct sim_mcu *m, uint64_t t, sim_event_fn fn, void *ctx);
+
+void sim_prof_print(struct sim_mcu *m, FILE *f);
+const struct sim_prof *sim_prof_find(struct sim_mcu *m, const char *fn);
+
+void sim_power_print(struct sim_mcu *m, FILE *f);
+double sim_current_ua(struct sim_mcu *m);
+
+double sim_seconds(uint64_t ps);
+
+#endif
@@ -0,0 +1,430 @@
+/******************************************************************************
+ * smsbench - end to end door open latency, SMS Server to SMS Client
+ *
+ *   smsbench [-n opens] [-b baud] [-r tries] [-i ms] [-l pct] [-e ppm] [-L us]
+ *            [-x us] [-j] server.so client.so
+ *
+ * Runs both firmware images on one timeline. The host sends CMD_OPEN for node
+ * 1 to the server's UART; what the server clocks into its RF-24G goes on the
+ * virtual air (air.h) and comes out of the client's, and the client's acks
+ * the other way. The tries each open took are counted off the server's
+ * RF-24G, to see OpenDoor() repeat MSG_OPEN under loss.
+ * Each open is timed from the stop bit of the command to the client's LEDs
+ * going on (openDoor()), and to the server's CMD_OPEN|CMD_EVENT. The next one
+ * goes out once the door has closed again, a pseudo-random 0-5ms later so the
+ * opens land on every phase of the watchdog tick.
+ * With -r or -i the server gets a CMD_CONFIG first, to see what fewer or
+ * more tries buy: the share of opens that reach the door, and how soon.
+ *
+ *   -n   opens to time (default 20)
+ *   -b   baud rate of the server's UART, as it was built (default 2400)
+ *   -r   tries per open, CMD_CONFIG (default the firmware's, OPEN_COUNT)
+ *   -i   ms between tries, CMD_CONFIG (default 42, OPEN_INTERVAL_US's)
+ *   -l   percent of packets lost on the air, each way (default 0)
+ *   -e   bit errors per million bits on the air (default 0)
+ *   -L   us from the end of a packet on the air to DR (default 0)
+ *   -x   exit 1 if an open takes more than this many us to reach the door, or
+ *        never does
+ *   -j   print the results as one line of JSON on stdout
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "sim.h"
+#include "uart.h"
+#include "rfsrc.h"
+#include "air.h"
+#include "../SMS Server/cmd.h"
+#include "../SMS Server/door.h"
+
+#define TXD     0x02    // P1.1
+#define RXD     0x04    // P1.2
+#define LEDS    0x41    // P1.0 and P1.6, openDoor()
+#define SLICE   (20 * SIM_PS_PER_US)    // lock step, under RF_TX_SETTLE (air.h)
+#define TIMEOUT (8 * SIM_PS_PER_S)      // OPEN_COUNT tries and then some
+#define OPEN_COUNT      120     // the server's defaults, main.c
+#define INTERVAL_MS     42
+#define BINS    10
+
+static const uint32_t key[4] = SIM_DOOR_KEY;
+
+struct bench {
+    struct sim_mcu *server, *client;
+    struct sim_uart uart;
+    struct sim_rfsrc *srf;
+    unsigned n;                 // opens to time
+    unsigned tries_max, interval_ms;    // CMD_CONFIG, 0 to leave the defaults
+    int configured;
+    unsigned next;              // and sent so far
+    uint64_t sent;              // stop bit of the last CMD_OPEN
+    uint64_t deadline;
+    int door, acked, closed;    // for the last one
+    int queued;                 // the next one is on its way
+    uint64_t *door_ps;          // per open, 0 if the door never opened
+    uint64_t *ack_ps;           // 0 if not acked
+    unsigned *tries;            // MSG_OPENs the server sent for it
+    unsigned heard;             // the server's packets before it
+    unsigned opened, acks;
+    uint32_t rnd;
+    uint8_t buf[32];            // frame from the server
+    int len, esc;
+};
+
+static uint8_t frame_crc(const uint8_t *p, int n)
+{
+    uint8_t crc = 0;
+    int i;
+    while(n--){
+        crc ^= *p++;
+        for(i=0; i<8; i++)
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+}
+
+//SLIP frames body, len bytes and its CRC, to the server
+static void bench_send(struct bench *b, uint64_t t, uint8_t *body, int len)
+{
+    uint8_t out[2 * (FRAME_MAX + 1) + 2];
+    int n = 0, i;
+    body[len] = frame_crc(body, len);
+    len++;
+    out[n++] = SLIP_END;
+    for(i=0; i<len; i++){
+        if(body[i] == SLIP_END || body[i] == SLIP_ESC){
+            out[n++] = SLIP_ESC;
+            out[n++] = body[i] == SLIP_END ? SLIP_ESC_END : SLIP_ESC_ESC;
+        }else{
+            out[n++] = body[i];
+        }
+    }
+    out[n++] = SLIP_END;
+    sim_uart_send(&b->uart, t, out, n);
+}
+
+static void bench_open(void *ctx, struct sim_mcu *m, uint64_t t)
+{
+    struct bench *b = ctx;
+    uint8_t body[FRAME_MAX + 1];
+    (void)m;
+    body[0] = b->next + 1;      // tag
+    body[1] = CMD_OPEN;
+    body[2] = 1;                // the client's node
+    bench_send(b, t, body, 3);
+    b->sent = b->uart.free_at;
+    b->deadline = b->sent + TIMEOUT;
+    if(b->tries_max)            // all of them, and the ack's worth again
+        b->deadline = b->sent + (uint64_t)(b->tries_max + 1) * b->interval_ms * SIM_PS_PER_MS
+                      + SIM_PS_PER_S;
+    b->heard = b->srf->heard;
+    b->door = b->acked = b->closed = b->queued = 0;
+    b->next++;
+}
+
+//tag 0, before the first open
+static void bench_config(void *ctx, struct sim_mcu *m, uint64_t t)
+{
+    struct bench *b = ctx;
+    uint8_t body[FRAME_MAX + 1];
+    (void)m;
+    body[0] = 0;
+    body[1] = CMD_CONFIG;
+    body[2] = b->tries_max;
+    body[3] = b->interval_ms >> 8;
+    body[4] = b->interval_ms;
+    bench_send(b, t, body, 5);
+}
+
+//once the last open is over and the door shut, the next one
+static void bench_done(struct bench *b, uint64_t t)
+{
+    uint32_t x = b->rnd;
+    if(!b->acked || (b->door && !b->closed) || b->next >= b->n || b->queued)
+        return;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    b->rnd = x;
+    b->queued = 1;
+    sim_at(b->server, t + x % (5 * SIM_PS_PER_MS), bench_open, b);
+}
+
+static void bench_leds(void *ctx, struct sim_mcu *m, int port,
+                       uint8_t changed, uint8_t level, uint64_t t)
+{
+    struct bench *b = ctx;
+    (void)m;
+    if(port != 1 || !(changed & LEDS) || !b->next)
+        return;
+    if((level & LEDS) && !b->door){
+        b->door = 1;
+        b->door_ps[b->next - 1] = t - b->sent;
+        b->opened++;
+    }else if(!(level & LEDS) && b->door){
+        b->closed = 1;
+        bench_done(b, t);
+    }
+}
+
+static void bench_recv(void *ctx, uint8_t c, uint64_t t)
+{
+    struct bench *b = ctx;
+    if(c == SLIP_END){
+        if(b->len == 4 && frame_crc(b->buf, 3) == b->buf[3] && !b->buf[0]
+           && b->buf[1] == (CMD_CONFIG | CMD_REPLY)){
+            if(b->buf[2] != ST_OK){
+                fprintf(stderr, "smsbench: CMD_CONFIG %u tries %u ms: status %u\n",
+                        b->tries_max, b->interval_ms, b->buf[2]);
+                exit(1);
+            }
+            b->configured = 1;
+            sim_at(b->server, t, bench_open, b);
+        }else if(b->len == 5 && frame_crc(b->buf, 4) == b->buf[4]
+           && b->buf[1] == (CMD_OPEN | CMD_EVENT) && b->buf[0] == b->next){
+            b->acked = 1;
+            b->tries[b->next - 1] = b->srf->heard - b->heard;
+            if(b->buf[2] & FLAG_ACKED){
+                b->ack_ps[b->next - 1] = t - b->sent;
+                b->acks++;
+            }
+            bench_done(b, t);
+        }
+        b->len = b->esc = 0;
+    }else if(c == SLIP_ESC){
+        b->esc = 1;
+    }else{
+        if(b->esc)
+            c = c == SLIP_ESC_END ? SLIP_END : c == SLIP_ESC_ESC ? SLIP_ESC : c;
+        b->esc = 0;
+        if(b->len < (int)sizeof(b->buf))
+            b->buf[b->len++] = c;
+    }
+}
+
+static int cmp_uint(const void *a, const void *b)
+{
+    unsigned x = *(const unsigned *)a, y = *(const unsigned *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+//the ones that made it, sorted; returns how many
+static int sorted(const uint64_t *ps, unsigned n, uint64_t *out)
+{
+    unsigned i;
+    int k = 0;
+    for(i=0; i<n; i++)
+        if(ps[i])
+            out[k++] = ps[i];
+    qsort(out, k, sizeof(*out), cmp_u64);
+    return k;
+}
+
+static double pct(const uint64_t *s, int k, int p)
+{
+    return k ? s[(k - 1) * p / 100] / 1e6 : 0;
+}
+
+static double mean(const uint64_t *s, int k)
+{
+    double sum = 0;
+    int i;
+    for(i=0; i<k; i++)
+        sum += s[i];
+    return k ? sum / k / 1e6 : 0;
+}
+
+//bin width, 1, 2 or 5 times a power of ten us, for BINS bins over the range
+static double bin_us(const uint64_t *s, int k)
+{
+    double range = k ? (s[k-1] - s[0]) / 1e6 : 0, w = 1;
+    while(w * BINS < range){
+        if(w * 2 * BINS >= range)
+            return w * 2;
+        if(w * 5 * BINS >= range)
+            return w * 5;
+        w *= 10;
+    }
+    return w;
+}
+
+static void stats(FILE *f, const char *name, const uint64_t *s, int k, unsigned n)
+{
+    fprintf(f, "%s: %d of %u, min/p50/p90/max %.1f/%.1f/%.1f/%.1f us, mean %.1f us\n",
+            name, k, n, pct(s, k, 0), pct(s, k, 50), pct(s, k, 90), pct(s, k, 100), mean(s, k));
+}
+
+static void json_stats(const char *name, const uint64_t *s, int k)
+{
+    printf("\"%s\":{\"n\":%d,\"min\":%.1f,\"p50\":%.1f,\"p90\":%.1f,\"max\":%.1f,\"mean\":%.1f}",
+           name, k, pct(s, k, 0), pct(s, k, 50), pct(s, k, 90), pct(s, k, 100), mean(s, k));
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: smsbench [-n opens] [-b baud] [-r tries] [-i ms] [-l pct] [-e ppm]\n"
+                    "                [-L us] [-x us] [-j] server.so client.so\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    struct bench b;
+    struct sim_rfsrc srf, crf;
+    struct sim_air air;
+    unsigned baud = 2400, *tries, done = 0, repeated = 0;
+    double max_us = 0, sum = 0;
+    int json = 0, c, k, a, i, fail = 0;
+    uint64_t t, *door, *ack;
+    double w, wall;
+    int hist[BINS + 1];
+    struct timespec t0, t1;
+
+    memset(&b, 0, sizeof(b));
+    b.n = 20;
+    b.rnd = 2463534242u;
+    sim_air_init(&air);
+    while((c = getopt(argc, argv, "n:b:r:i:l:e:L:x:j")) != -1){
+        switch(c){
+        case 'n': b.n = atoi(optarg); break;
+        case 'b': baud = atoi(optarg); break;
+        case 'r': b.tries_max = atoi(optarg); break;
+        case 'i': b.interval_ms = atoi(optarg); break;
+        case 'l': air.loss = atoi(optarg); break;
+        case 'e': air.ber = atoi(optarg); break;
+        case 'L': air.latency = atof(optarg) * SIM_PS_PER_US; break;
+        case 'x': max_us = atof(optarg); break;
+        case 'j': json = 1; break;
+        default: usage();
+        }
+    }
+    if(optind != argc - 2 || !b.n || !baud || b.tries_max > 255 || b.interval_ms > CONFIG_MAX_MS)
+        usage();
+    if(b.tries_max || b.interval_ms){
+        b.tries_max = b.tries_max ? b.tries_max : OPEN_COUNT;
+        b.interval_ms = b.interval_ms ? b.interval_ms : INTERVAL_MS;
+    }
+
+    b.server = sim_mcu_new(argv[optind], argv[optind]);
+    b.client = sim_mcu_new(argv[optind+1], argv[optind+1]);
+    if(!b.server || !b.server->entry || !b.client || !b.client->entry)
+        return 1;
+    sim_mcu_info32(b.server, INFO_KEY_ADDR, key, 4);
+    sim_mcu_info32(b.client, INFO_KEY_ADDR, key, 4);
+    sim_mcu_charge(b.server, "speck64", SIM_SPECK64_CYCLES);
+    sim_mcu_charge(b.client, "speck64", SIM_SPECK64_CYCLES);
+    b.door_ps = calloc(b.n, sizeof(uint64_t));
+    b.ack_ps = calloc(b.n, sizeof(uint64_t));
+    b.tries = calloc(b.n, sizeof(unsigned));
+    tries = calloc(b.n, sizeof(unsigned));
+    door = calloc(b.n, sizeof(uint64_t));
+    ack = calloc(b.n, sizeof(uint64_t));
+
+    sim_uart_init(&b.uart, b.server, TXD, RXD, baud);
+    b.uart.recv = bench_recv;
+    b.uart.ctx = &b;
+    sim_rfsrc_init(&srf, b.server, 0);
+    sim_rfsrc_init(&crf, b.client, 0);
+    sim_air_join(&air, &srf);
+    sim_air_join(&air, &crf);
+    b.srf = &srf;
+    sim_pin_watch(b.client, bench_leds, &b);
+    sim_at(b.server, 100 * SIM_PS_PER_MS,                   // after the banners
+           b.tries_max ? bench_config : bench_open, &b);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(t=0; ; ){
+        t += SLICE;
+        if(sim_mcu_run(b.server, t) || sim_mcu_run(b.client, t))
+            break;
+        sim_uart_flush(&b.uart, b.server->now);
+        sim_air_flush(&air);
+        if(b.next && t > b.deadline && !b.acked)
+            break;              // the server never answered
+        if(b.tries_max && !b.configured && t > TIMEOUT)
+            break;              // nor to CMD_CONFIG
+        if(b.next == b.n && b.acked && (!b.door || b.closed))
+            break;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    k = sorted(b.door_ps, b.n, door);
+    a = sorted(b.ack_ps, b.n, ack);
+    w = bin_us(door, k);
+    memset(hist, 0, sizeof(hist));
+    for(i=0; i<k; i++)
+        hist[(int)((door[i] - door[0]) / 1e6 / w)]++;
+    for(i=0; i<(int)b.n; i++){
+        if(b.tries[i]){
+            tries[done++] = b.tries[i];
+            sum += b.tries[i];
+            repeated += b.tries[i] > 1;
+        }
+    }
+    qsort(tries, done, sizeof(*tries), cmp_uint);
+    sim_air_count(&air);
+    if(max_us > 0 && (k < (int)b.n || pct(door, k, 100) > max_us))
+        fail = 1;
+
+    fprintf(stderr, "%s + %s: %.3f s simulated in %.2f s, %llu + %llu cycles, payload %d\n",
+            b.server->name, b.client->name, sim_seconds(t), wall,
+            (unsigned long long)b.server->cycles, (unsigned long long)b.client->cycles,
+            crf.ch[0].width);
+    fprintf(stderr, "cycles and the MCU's part of the times are %s\n", SIM_LOWER_BOUND);
+    if(b.tries_max)
+        fprintf(stderr, "config: %u tries %u ms apart, %u of %u opens reached the door, %.1f%%\n",
+                b.tries_max, b.interval_ms, k, b.n, 100.0 * k / b.n);
+    stats(stderr, "door", door, k, b.n);
+    stats(stderr, "ack", ack, a, b.n);
+    if(done)
+        fprintf(stderr, "tries: p50/p90/max %u/%u/%u, mean %.2f, %u of %u opens repeated\n",
+                tries[(done - 1) / 2], tries[(done - 1) * 9 / 10], tries[done - 1],
+                sum / done, repeated, done);
+    fprintf(stderr, "air: %u packets, %u lost, %u collided, %u with bit errors; "
+            "%u + %u CRC errors, %u + %u missed\n", air.sent, air.lost, air.collided, air.noisy,
+            srf.crc_errors, crf.crc_errors, srf.ch[0].missed, crf.ch[0].missed);
+    for(i=0; i<BINS + 1 && k; i++){
+        if(!hist[i] && door[0] / 1e6 + i * w > door[k-1] / 1e6)
+            break;
+        fprintf(stderr, "%9.1f us %4d %.*s\n", door[0] / 1e6 + i * w, hist[i], hist[i] > 60 ? 60 : hist[i],
+                "############################################################");
+    }
+    if(fail)
+        fprintf(stderr, "FAIL: door not opened within %.0f us every time\n", max_us);
+
+    if(json){
+        printf("{\"server\":\"%s\",\"client\":\"%s\",\"mclk_hz\":[%u,%u],\"baud\":%u,\"payload\":%d,"
+               "\"opens\":%u,\"open_tries\":%u,\"interval_ms\":%u,\"success\":%.3f,",
+               b.server->name, b.client->name, b.server->mclk_hz, b.client->mclk_hz,
+               baud, crf.ch[0].width, b.n, b.tries_max ? b.tries_max : OPEN_COUNT,
+               b.interval_ms ? b.interval_ms : INTERVAL_MS, (double)k / b.n);
+        json_stats("door_us", door, k);
+        printf(",");
+        json_stats("ack_us", ack, a);
+        printf(",\"door_cycles_p50\":%.0f,\"door_hist\":{\"from_us\":%.1f,\"bin_us\":%g,\"counts\":[",
+               pct(door, k, 50) * b.server->mclk_hz / 1e6, k ? door[0] / 1e6 : 0, w);
+        for(i=0; i<BINS + 1; i++)
+            printf("%s%d", i ? "," : "", hist[i]);
+        printf("]},\"loss_pct\":%u,\"ber_ppm\":%u,\"tries\":{\"n\":%u,\"p50\":%u,\"p90\":%u,"
+               "\"max\":%u,\"mean\":%.2f,\"repeated\":%u},\"air\":{\"sent\":%u,\"lost\":%u,"
+               "\"collided\":%u,\"noisy\":%u,\"crc_errors\":%u}", air.loss, air.ber, done,
+               done ? tries[(done - 1) / 2] : 0, done ? tries[(done - 1) * 9 / 10] : 0,
+               done ? tries[done - 1] : 0, done ? sum / done : 0, repeated, air.sent, air.lost,
+               air.collided, air.noisy, srf.crc_errors + crf.crc_errors);
+        printf(",\"cycles\":[%llu,%llu],\"estimated_cycles\":{\"speck64\":%d},\"sim_s\":%.3f,"
+               "\"wall_s\":%.3f,\"pass\":%s}\n",
+               (unsigned long long)b.server->cycles, (unsigned long long)b.client->cycles,
+               SIM_SPECK64_CYCLES, sim_seconds(t), wall, fail ? "false" : "true");
+    }
+    sim_mcu_free(b.server);
+    sim_mcu_free(b.client);
+    return fail;
+}
@@ -0,0 +1,284 @@
+/******************************************************************************
+ * smsfit - RAM, flash and stack headroom of a linked firmware image
+ *
+ *   smsfit [-m bytes] [-l bytes] map [file.asm...]
+ *
+ * Reads what RAM and FLASH have used of their length, and the size of
+ * .stack, from the TI linker's map. With the compiler's assembly (cl430 -k,
+ * one file per source), it also works out how deep the stack gets: the
+ * deepest call chain from main, then the deepest interrupt on top of it.
+ * Only one interrupt counts, none of them turn GIE back on. A function's
+ * own part is the "Local Frame Size" in its header plus the return address
+ * its CALL pushed, 4 bytes of PC and SR for an interrupt.
+ *
+ *   -m   bytes each of RAM, FLASH and .stack must have left over (default 0)
+ *   -l   stack for a call into a function with no assembly, the rts's
+ *        helpers (default 8)
+ *
+ * Exits 1 if anything is over, or the assembly has a call it can't follow.
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#define MAX_FUNCS   256
+#define MAX_CALLS   16
+#define NAME_LEN    64
+
+struct func {
+    char name[NAME_LEN];
+    int frame;                  // Local Frame Size, -1 until its header is read
+    int isr;                    // returns with RETI
+    int ncalls;
+    int calls[MAX_CALLS];
+    int depth;                  // deepest below and including it, -1 not yet
+    int next;                   // callee on that path, -1 for none
+    int busy;                   // on the path being worked out, for recursion
+};
+
+static struct func funcs[MAX_FUNCS];
+static int nfuncs;
+static int unknown = 8;
+static int bad;
+
+static int func_find(const char *name)
+{
+    int i;
+    for(i=0; i<nfuncs; i++)
+        if(!strcmp(funcs[i].name, name))
+            return i;
+    if(nfuncs == MAX_FUNCS){
+        fprintf(stderr, "smsfit: more than %d functions\n", MAX_FUNCS);
+        exit(1);
+    }
+    snprintf(funcs[nfuncs].name, NAME_LEN, "%s", name);
+    funcs[nfuncs].frame = -1;
+    funcs[nfuncs].depth = -1;
+    funcs[nfuncs].next = -1;
+    return nfuncs++;
+}
+
+//C name of a COFF symbol: _main is main
+static void symbol(char *dst, const char *s)
+{
+    int n = 0;
+    if(*s == '_')
+        s++;
+    while(n < NAME_LEN - 1 && (isalnum((unsigned char)*s) || *s == '_' || *s == '$'))
+        dst[n++] = *s++;
+    dst[n] = 0;
+}
+
+static void add_call(int f, const char *target)
+{
+    char name[NAME_LEN];
+    int c, i;
+    symbol(name, target);
+    c = func_find(name);
+    for(i=0; i<funcs[f].ncalls; i++)
+        if(funcs[f].calls[i] == c)
+            return;
+    if(funcs[f].ncalls == MAX_CALLS){
+        fprintf(stderr, "smsfit: %s calls more than %d functions\n", funcs[f].name, MAX_CALLS);
+        exit(1);
+    }
+    funcs[f].calls[funcs[f].ncalls++] = c;
+}
+
+//the mnemonic of an instruction line, after the label column; 0 for none
+static const char *mnemonic(const char *l)
+{
+    if(!isspace((unsigned char)*l))
+        return 0;
+    while(isspace((unsigned char)*l))
+        l++;
+    return *l && *l != ';' ? l : 0;
+}
+
+static void read_asm(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char l[256], name[NAME_LEN];
+    const char *p, *m;
+    int cur = -1, n;
+    if(!f){
+        perror(path);
+        exit(1);
+    }
+    while(fgets(l, sizeof(l), f)){
+        if((p = strstr(l, "FUNCTION NAME:"))){
+            p += strlen("FUNCTION NAME:");
+            while(isspace((unsigned char)*p))
+                p++;
+            symbol(name, p);
+            cur = func_find(name);
+            continue;
+        }
+        if(cur < 0)
+            continue;
+        if((p = strstr(l, "Local Frame Size")) && (p = strchr(p, '='))){
+            if(sscanf(p + 1, "%d", &n) == 1)
+                funcs[cur].frame = n;
+            continue;
+        }
+        if(!(m = mnemonic(l)))
+            continue;
+        if(!strncasecmp(m, "RETI", 4) && !isalnum((unsigned char)m[4]))
+            funcs[cur].isr = 1;
+        else if(!strncasecmp(m, "CALL", 4) || !strncasecmp(m, "BR", 2)){
+            p = m + (toupper((unsigned char)*m) == 'C' ? 4 : 2);
+            if(!isspace((unsigned char)*p))
+                continue;               // CALLA, BRA and the like
+            while(isspace((unsigned char)*p))
+                p++;
+            if(*p == '#' && p[1] == '_')
+                add_call(cur, p + 1);   // a BR to a label in the function has no _
+            else if(toupper((unsigned char)*m) == 'C'){
+                fprintf(stderr, "smsfit: %s: indirect call in %s, not followed\n", path,
+                        funcs[cur].name);
+                bad = 1;
+            }
+        }
+    }
+    fclose(f);
+}
+
+//deepest the stack gets from entering f, its return address not included
+static int depth(int f)
+{
+    struct func *fn = &funcs[f];
+    int i, d;
+    if(fn->depth >= 0)
+        return fn->depth;
+    if(fn->busy){
+        fprintf(stderr, "smsfit: %s is recursive, no bound\n", fn->name);
+        bad = 1;
+        return 0;
+    }
+    if(fn->frame < 0){
+        fn->depth = unknown - 2;        // the rts's, 2 of it is the CALL's
+        return fn->depth;
+    }
+    fn->busy = 1;
+    fn->depth = fn->frame;
+    for(i=0; i<fn->ncalls; i++){
+        d = fn->frame + 2 + depth(fn->calls[i]);
+        if(d > fn->depth){
+            fn->depth = d;
+            fn->next = fn->calls[i];
+        }
+    }
+    fn->busy = 0;
+    return fn->depth;
+}
+
+static void print_path(int f)
+{
+    for(; f >= 0; f = funcs[f].next)
+        fprintf(stderr, " %s%s", funcs[f].name, funcs[f].frame < 0 ? "(rts)" : "");
+    fprintf(stderr, "\n");
+}
+
+struct region {
+    const char *name;
+    unsigned long origin, length, used;
+    int found;
+};
+
+//MEMORY CONFIGURATION rows and the .stack line of the SECTION ALLOCATION MAP
+static void read_map(const char *path, struct region *r, int nr, unsigned long *stack)
+{
+    FILE *f = fopen(path, "r");
+    char l[256], name[NAME_LEN];
+    unsigned long origin, length, used;
+    int i, page;
+    if(!f){
+        perror(path);
+        exit(1);
+    }
+    *stack = 0;
+    while(fgets(l, sizeof(l), f)){
+        if(sscanf(l, " %63s %lx %lx %lx", name, &origin, &length, &used) == 4){
+            for(i=0; i<nr; i++)
+                if(!strcmp(name, r[i].name) && !r[i].found){
+                    r[i].origin = origin;
+                    r[i].length = length;
+                    r[i].used = used;
+                    r[i].found = 1;
+                }
+        }
+        if(sscanf(l, ".stack %d %lx %lx", &page, &origin, &length) == 3)
+            *stack = length;
+    }
+    fclose(f);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: smsfit [-m bytes] [-l bytes] map [file.asm...]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    struct region r[] = { { "RAM" }, { "FLASH" } };
+    unsigned long stack;
+    long left;
+    int margin = 0, c, i, f, isr = -1, main_d, isr_d = 0;
+
+    while((c = getopt(argc, argv, "m:l:")) != -1){
+        switch(c){
+        case 'm': margin = atoi(optarg); break;
+        case 'l': unknown = atoi(optarg); break;
+        default: usage();
+        }
+    }
+    if(optind >= argc || unknown < 2)
+        usage();
+
+    read_map(argv[optind], r, 2, &stack);
+    for(i=0; i<2; i++){
+        if(!r[i].found){
+            fprintf(stderr, "smsfit: %s: no %s in the MEMORY CONFIGURATION\n", argv[optind], r[i].name);
+            return 1;
+        }
+        left = (long)r[i].length - (long)r[i].used;
+        fprintf(stderr, "%-6s %5lu of %5lu bytes, %4ld left\n", r[i].name, r[i].used, r[i].length, left);
+        if(left < margin)
+            bad = 1;
+    }
+    fprintf(stderr, "%-6s %5lu of the RAM's, %lu static\n", ".stack", stack, r[0].used - stack);
+
+    for(i=optind+1; i<argc; i++)
+        read_asm(argv[i]);
+    if(optind + 1 < argc){
+        f = func_find("main");
+        if(funcs[f].frame < 0){
+            fprintf(stderr, "smsfit: no main in the assembly\n");
+            return 1;
+        }
+        main_d = depth(f) + 2;          // _c_int00 calls it
+        for(f=0; f<nfuncs; f++){
+            if(funcs[f].isr && depth(f) + 4 > isr_d){
+                isr_d = depth(f) + 4;
+                isr = f;
+            }
+        }
+        left = (long)stack - main_d - isr_d;
+        fprintf(stderr, "%-6s %5d of %5lu bytes, %4ld left\n", "stack", main_d + isr_d, stack, left);
+        fprintf(stderr, "  %3d:", main_d);
+        print_path(func_find("main"));
+        if(isr >= 0){
+            fprintf(stderr, "+ %3d:", isr_d);
+            print_path(isr);
+        }
+        if(left < margin)
+            bad = 1;
+    }
+    if(bad)
+        fprintf(stderr, "FAIL: each needs %d bytes to spare, and every call followed\n", margin);
+    return bad;
+}
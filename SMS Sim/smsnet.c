@@ -0,0 +1,488 @@
+/******************************************************************************
+ * smsnet - many SMS Servers and SMS Clients on one virtual air
+ *
+ *   smsnet [-s servers] [-c clients] [-t seconds] [-g ms] [-b baud] [-T threads]
+ *          [-l pct] [-e ppm] [-j] server.so client.so
+ *
+ * Loads a copy of server.so per server and of client.so per door, all on one
+ * timeline and one sim_air (air.h). The doors are nodes 1, 2... (SERVER_NODE
+ * skipped), programmed into info memory at INFO_NODE_ADDR (door.h), and the
+ * i-th door belongs to server i % servers: each server is an installation
+ * with its own doors, but they share the air, the HOP_CHANNELS and the
+ * SERVER_NODE address. Every MCU powers on at its own time within SKEW and
+ * its DCO is off by up to DCO_PPM, as no two parts agree. From 100ms on the
+ * host sends each server CMD_OPEN for one of its doors at random, and once
+ * that is over the next one 0 to 2*g ms later.
+ * Reported: opens acked, the tries each took (the server's RF-24G), the time
+ * from the command to the door's LEDs, opens that went to a door nobody
+ * asked for (the MAC should see to none), collisions and the packets servers
+ * took from another server's doors, with SERVER_NODE shared.
+ *
+ * The MCUs run in steps of STEP, each one on its own, and the air and the
+ * host catch up between steps. A step is shared out over the threads as one
+ * task per MCU: every thread starts with an even share and, when done with
+ * its own, steals from the others, so one MCU with a lot to do (a server in
+ * the MAC) holds up one thread, not the step. The outcome does not depend on
+ * who ran what.
+ *
+ *   -s   servers (default 1)
+ *   -c   doors (default 16, at most 253)
+ *   -t   simulated time (default 2s)
+ *   -g   mean gap between one server's opens, ms (default 100)
+ *   -b   baud rate of the servers' UART, as they were built (default 2400)
+ *   -T   threads (default: one per CPU)
+ *   -l   percent of packets lost on the air, each way (default 0)
+ *   -e   bit errors per million bits on the air (default 0)
+ *   -j   print the results as one line of JSON on stdout
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "sim.h"
+#include "uart.h"
+#include "rfsrc.h"
+#include "air.h"
+#include "../SMS Server/door.h"
+#include "../SMS Server/cmd.h"
+
+#define TXD     0x02    // P1.1
+#define RXD     0x04    // P1.2
+#define LEDS    0x41    // P1.0 and P1.6, openDoor()
+#define STEP    (RF_TX_SETTLE / 2)      // lock step, see air.h
+#define START   (100 * SIM_PS_PER_MS)   // after the banners
+#define SKEW    (10 * SIM_PS_PER_MS)    // power-on spread
+#define DCO_PPM 10000                   // and DCO spread, +-; with clocks in
+                                        // step two servers' tries that
+                                        // collide once would every time
+#define MAX_DOORS   253                 // node IDs but SERVER_NODE and 0xFF
+
+static const uint32_t key[4] = SIM_DOOR_KEY;
+
+struct door {
+    struct sim_mcu *m;
+    struct sim_rfsrc rf;
+    uint8_t node;
+    uint64_t lit;               // LEDs went on, for the host to match up
+};
+
+struct server {
+    struct sim_mcu *m;
+    struct sim_rfsrc rf;
+    struct sim_uart uart;
+    int id;
+    uint8_t tag;
+    struct door *door;          // of the open going on, NULL between opens
+    uint64_t sent;              // stop bit of its CMD_OPEN
+    int over;                   // its CMD_OPEN|CMD_EVENT is in
+    int going;                  // its CMD_OPEN is out and that is not
+    int opened;                 // the door's LEDs went on for it
+    unsigned heard;             // rf.heard when it went out
+    uint8_t buf[32];
+    int len, esc;
+
+    //results
+    unsigned opens, acked, tries, doors;
+    uint64_t door_ps;
+};
+
+//a thread's share of a step; it takes from the tail, thieves from the head
+struct task_queue {
+    pthread_mutex_t lock;
+    int head, tail;
+    int *task;
+    unsigned steals;            // by this thread, from the others
+    int fault;                  // an MCU it ran stopped
+};
+
+struct net {
+    struct server *srv;
+    struct door *dr;
+    int servers, doors;
+    struct sim_mcu **mcu;       // servers, then doors
+    int mcus;
+    uint64_t gap;
+    uint32_t rnd;
+    unsigned unasked;           // doors that opened with no open for them
+
+    //step
+    int threads;
+    uint64_t until;
+    struct task_queue *q;
+    pthread_barrier_t go, done;
+    int quit;
+    uint64_t *door_ps;          // every open's, for the percentiles
+    unsigned n_door;
+};
+
+static uint32_t net_rand(struct net *n)
+{
+    uint32_t x = n->rnd;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    n->rnd = x;
+    return x;
+}
+
+static uint8_t frame_crc(const uint8_t *p, int n)
+{
+    uint8_t crc = 0;
+    int i;
+    while(n--){
+        crc ^= *p++;
+        for(i=0; i<8; i++)
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+}
+
+/*******************************************************************************
+ * host side; the callbacks run on the thread of their MCU and only touch its
+ * own server or door, the rest happens between steps
+ ******************************************************************************/
+static void net_open(void *ctx, struct sim_mcu *m, uint64_t t)
+{
+    struct server *s = ctx;
+    uint8_t body[4], out[10];
+    int n = 0, i;
+    (void)m;
+    body[0] = ++s->tag ? s->tag : ++s->tag;     // tag 0 is for events
+    body[1] = CMD_OPEN;
+    body[2] = s->door->node;
+    body[3] = frame_crc(body, 3);
+    out[n++] = SLIP_END;
+    for(i=0; i<4; i++){
+        if(body[i] == SLIP_END || body[i] == SLIP_ESC){
+            out[n++] = SLIP_ESC;
+            out[n++] = body[i] == SLIP_END ? SLIP_ESC_END : SLIP_ESC_ESC;
+        }else{
+            out[n++] = body[i];
+        }
+    }
+    out[n++] = SLIP_END;
+    sim_uart_send(&s->uart, t, out, n);
+    s->sent = s->uart.free_at;
+    s->heard = s->rf.heard;
+    s->going = 1;
+    s->opens++;
+}
+
+static void net_recv(void *ctx, uint8_t c, uint64_t t)
+{
+    struct server *s = ctx;
+    (void)t;
+    if(c == SLIP_END){
+        if(s->len == 5 && frame_crc(s->buf, 4) == s->buf[4] && s->door
+           && s->buf[1] == (CMD_OPEN | CMD_EVENT) && s->buf[0] == s->tag){
+            s->over = 1;
+            s->going = 0;
+            s->tries += s->rf.heard - s->heard;
+            s->acked += !!(s->buf[2] & FLAG_ACKED);
+        }
+        s->len = s->esc = 0;
+    }else if(c == SLIP_ESC){
+        s->esc = 1;
+    }else{
+        if(s->esc)
+            c = c == SLIP_ESC_END ? SLIP_END : c == SLIP_ESC_ESC ? SLIP_ESC : c;
+        s->esc = 0;
+        if(s->len < (int)sizeof(s->buf))
+            s->buf[s->len++] = c;
+    }
+}
+
+static void net_leds(void *ctx, struct sim_mcu *m, int port,
+                     uint8_t changed, uint8_t level, uint64_t t)
+{
+    struct door *d = ctx;
+    (void)m;
+    if(port == 1 && (changed & LEDS) && (level & LEDS) && !d->lit)
+        d->lit = t;
+}
+
+//the next open for server s, one of its doors, at t
+static void net_next(struct net *n, struct server *s, uint64_t t)
+{
+    int mine = (n->doors - s->id + n->servers - 1) / n->servers;
+    if(!mine)
+        return;
+    s->door = &n->dr[s->id + net_rand(n) % mine * n->servers];
+    s->over = s->opened = 0;
+    sim_at(s->m, t, net_open, s);
+}
+
+//between steps: doors that opened, and servers ready for the next open
+static void net_host(struct net *n, uint64_t t)
+{
+    int i;
+    for(i=0; i<n->doors; i++){
+        struct door *d = &n->dr[i];
+        struct server *s = &n->srv[i % n->servers];
+        if(!d->lit)
+            continue;
+        if(s->door == d && !s->opened && d->lit > s->sent){
+            s->opened = 1;
+            s->doors++;
+            s->door_ps += d->lit - s->sent;
+            n->door_ps[n->n_door++ % (1 << 16)] = d->lit - s->sent;
+        }else{
+            n->unasked++;
+        }
+        d->lit = 0;
+    }
+    for(i=0; i<n->servers; i++){
+        struct server *s = &n->srv[i];
+        sim_uart_flush(&s->uart, t);
+        if(s->door && s->over)
+            net_next(n, s, t + net_rand(n) % (2 * n->gap + 1));
+    }
+}
+
+/*******************************************************************************
+ * work stealing over the MCUs of a step
+ ******************************************************************************/
+static int net_take(struct net *n, int id)
+{
+    struct task_queue *q = &n->q[id];
+    int task = -1, i;
+    pthread_mutex_lock(&q->lock);
+    if(q->tail > q->head)
+        task = q->task[--q->tail];
+    pthread_mutex_unlock(&q->lock);
+    for(i=1; task < 0 && i<n->threads; i++){
+        q = &n->q[(id + i) % n->threads];
+        pthread_mutex_lock(&q->lock);
+        if(q->tail > q->head)
+            task = q->task[q->head++];
+        pthread_mutex_unlock(&q->lock);
+        n->q[id].steals += task >= 0;
+    }
+    return task;
+}
+
+static void net_work(struct net *n, int id)
+{
+    int task;
+    while((task = net_take(n, id)) >= 0){
+        if(sim_mcu_run(n->mcu[task], n->until))
+            n->q[id].fault = 1;
+    }
+}
+
+struct net_worker {
+    struct net *n;
+    int id;
+    pthread_t th;
+};
+
+static void *net_worker(void *arg)
+{
+    struct net_worker *w = arg;
+    struct net *n = w->n;
+    for(;;){
+        pthread_barrier_wait(&n->go);
+        if(n->quit)
+            break;
+        net_work(n, w->id);
+        pthread_barrier_wait(&n->done);
+    }
+    return NULL;
+}
+
+//every MCU up to `until`, an even share to each thread to start with
+static void net_step(struct net *n, uint64_t until)
+{
+    int i;
+    n->until = until;
+    for(i=0; i<n->threads; i++){
+        n->q[i].head = 0;
+        n->q[i].tail = 0;
+    }
+    for(i=0; i<n->mcus; i++){
+        struct task_queue *q = &n->q[(long)i * n->threads / n->mcus];
+        q->task[q->tail++] = i;
+    }
+    pthread_barrier_wait(&n->go);
+    net_work(n, 0);
+    pthread_barrier_wait(&n->done);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: smsnet [-s servers] [-c clients] [-t seconds] [-g ms] [-b baud] [-T threads]\n"
+                    "              [-l pct] [-e ppm] [-j] server.so client.so\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    struct net n;
+    struct sim_air air;
+    struct net_worker *w;
+    double seconds = 2, wall;
+    int json = 0, c, i, k, fault = 0;
+    unsigned baud = 2400, opens = 0, acked = 0, tries = 0, doors = 0, over = 0, steals = 0;
+    unsigned srv_missed = 0, door_missed = 0, crc_errors = 0;
+    uint64_t t, end;
+    struct timespec t0, t1;
+
+    memset(&n, 0, sizeof(n));
+    n.servers = 1;
+    n.doors = 16;
+    n.gap = 100 * SIM_PS_PER_MS;
+    n.rnd = 2463534242u;
+    n.threads = sysconf(_SC_NPROCESSORS_ONLN);
+    sim_air_init(&air);
+    while((c = getopt(argc, argv, "s:c:t:g:b:T:l:e:j")) != -1){
+        switch(c){
+        case 's': n.servers = atoi(optarg); break;
+        case 'c': n.doors = atoi(optarg); break;
+        case 't': seconds = atof(optarg); break;
+        case 'g': n.gap = atof(optarg) * SIM_PS_PER_MS; break;
+        case 'b': baud = atoi(optarg); break;
+        case 'T': n.threads = atoi(optarg); break;
+        case 'l': air.loss = atoi(optarg); break;
+        case 'e': air.ber = atoi(optarg); break;
+        case 'j': json = 1; break;
+        default: usage();
+        }
+    }
+    if(optind != argc - 2 || !baud || n.servers < 1 || n.doors < 1 || n.doors > MAX_DOORS
+       || n.servers + n.doors > SIM_AIR_NODES)
+        usage();
+    if(n.threads < 1)
+        n.threads = 1;
+
+    n.srv = calloc(n.servers, sizeof(*n.srv));
+    n.dr = calloc(n.doors, sizeof(*n.dr));
+    n.mcus = n.servers + n.doors;
+    n.mcu = calloc(n.mcus, sizeof(*n.mcu));
+    n.door_ps = calloc(1 << 16, sizeof(uint64_t));
+    for(i=0; i<n.servers; i++){
+        struct server *s = &n.srv[i];
+        s->id = i;
+        if(!(s->m = n.mcu[i] = sim_mcu_new(argv[optind], argv[optind])) || !s->m->entry)
+            return 1;
+        sim_mcu_info32(s->m, INFO_KEY_ADDR, key, 4);
+        sim_mcu_charge(s->m, "speck64", SIM_SPECK64_CYCLES);
+        s->m->now = net_rand(&n) % SKEW;
+        s->m->dco_ppm = (int)(net_rand(&n) % (2 * DCO_PPM + 1)) - DCO_PPM;
+        sim_uart_init(&s->uart, s->m, TXD, RXD, baud);
+        s->uart.recv = net_recv;
+        s->uart.ctx = s;
+        sim_rfsrc_init(&s->rf, s->m, 0);
+        sim_air_join(&air, &s->rf);
+        air.node[air.nodes - 1].net = i;
+    }
+    for(i=0, k=1; i<n.doors; i++, k++){
+        struct door *d = &n.dr[i];
+        if(k == SERVER_NODE)
+            k++;
+        d->node = k;
+        if(!(d->m = n.mcu[n.servers + i] = sim_mcu_new(argv[optind+1], argv[optind+1])) || !d->m->entry)
+            return 1;
+        sim_mcu_info(d->m, INFO_NODE_ADDR, d->node);
+        sim_mcu_info32(d->m, INFO_KEY_ADDR, key, 4);
+        sim_mcu_charge(d->m, "speck64", SIM_SPECK64_CYCLES);
+        d->m->now = net_rand(&n) % SKEW;
+        d->m->dco_ppm = (int)(net_rand(&n) % (2 * DCO_PPM + 1)) - DCO_PPM;
+        sim_rfsrc_init(&d->rf, d->m, 0);
+        sim_air_join(&air, &d->rf);
+        air.node[air.nodes - 1].net = i % n.servers;
+        sim_pin_watch(d->m, net_leds, d);
+    }
+    for(i=0; i<n.servers; i++)
+        net_next(&n, &n.srv[i], START + net_rand(&n) % (2 * n.gap + 1));
+
+    n.q = calloc(n.threads, sizeof(*n.q));
+    w = calloc(n.threads, sizeof(*w));
+    pthread_barrier_init(&n.go, NULL, n.threads);
+    pthread_barrier_init(&n.done, NULL, n.threads);
+    for(i=0; i<n.threads; i++){
+        pthread_mutex_init(&n.q[i].lock, NULL);
+        n.q[i].task = calloc(n.mcus, sizeof(int));
+        w[i].n = &n;
+        w[i].id = i;
+        if(i)
+            pthread_create(&w[i].th, NULL, net_worker, &w[i]);
+    }
+
+    end = seconds * SIM_PS_PER_S;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(t=0; t < end && !fault; ){
+        t += STEP;
+        net_step(&n, t);
+        sim_air_flush(&air);
+        net_host(&n, t);
+        for(i=0; i<n.threads; i++)
+            fault |= n.q[i].fault;
+    }
+    n.quit = 1;
+    pthread_barrier_wait(&n.go);
+    for(i=1; i<n.threads; i++)
+        pthread_join(w[i].th, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    for(i=0; i<n.threads; i++)
+        steals += n.q[i].steals;
+    for(i=0; i<n.servers; i++){
+        struct server *s = &n.srv[i];
+        opens += s->opens - s->going;
+        over += s->going;
+        acked += s->acked;
+        tries += s->tries;
+        doors += s->doors;
+        srv_missed += s->rf.ch[0].missed;
+        crc_errors += s->rf.crc_errors;
+    }
+    for(i=0; i<n.doors; i++){
+        door_missed += n.dr[i].rf.ch[0].missed;
+        crc_errors += n.dr[i].rf.crc_errors;
+    }
+    k = n.n_door < (1 << 16) ? n.n_door : (1 << 16);
+    qsort(n.door_ps, k, sizeof(uint64_t), cmp_u64);
+    sim_air_count(&air);
+
+    fprintf(stderr, "%d servers + %d doors: %.3f s simulated in %.2f s on %d threads, %u steals\n",
+            n.servers, n.doors, sim_seconds(t), wall, n.threads, steals);
+    fprintf(stderr, "opens: %u of %u acked, %.2f tries each, %u more going on\n",
+            acked, opens, opens ? (double)tries / opens : 0, over);
+    if(k)
+        fprintf(stderr, "door: %u opened, p50/p90/max %.1f/%.1f/%.1f us, %u nobody asked for\n",
+                doors, n.door_ps[(k - 1) / 2] / 1e6, n.door_ps[(k - 1) * 9 / 10] / 1e6,
+                n.door_ps[k - 1] / 1e6, n.unasked);
+    if(k)
+        fprintf(stderr, "door: the MCU cycles in those times are %s\n", SIM_LOWER_BOUND);
+    fprintf(stderr, "air: %u packets, %u lost, %u collided, %u with bit errors, %u taken, "
+            "%u of them from another installation\n",
+            air.sent, air.lost, air.collided, air.noisy, air.taken, air.crossed);
+    fprintf(stderr, "rf: %u CRC errors, %u packets missed by servers and %u by doors, "
+            "not listening or DR still up\n", crc_errors, srv_missed, door_missed);
+    if(json){
+        printf("{\"server\":\"%s\",\"client\":\"%s\",\"servers\":%d,\"doors\":%d,\"threads\":%d,"
+               "\"opens\":%u,\"acked\":%u,\"tries_mean\":%.2f,\"door_us\":{\"n\":%u,\"p50\":%.1f,"
+               "\"p90\":%.1f,\"max\":%.1f},\"unasked\":%u,\"air\":{\"sent\":%u,\"lost\":%u,"
+               "\"collided\":%u,\"noisy\":%u,\"taken\":%u,\"crossed\":%u},\"crc_errors\":%u,"
+               "\"missed\":[%u,%u],\"estimated_cycles\":{\"speck64\":%d},\"sim_s\":%.3f,"
+               "\"wall_s\":%.3f}\n",
+               argv[optind], argv[optind+1], n.servers, n.doors, n.threads,
+               opens, acked, opens ? (double)tries / opens : 0, doors,
+               k ? n.door_ps[(k - 1) / 2] / 1e6 : 0, k ? n.door_ps[(k - 1) * 9 / 10] / 1e6 : 0,
+               k ? n.door_ps[k - 1] / 1e6 : 0, n.unasked, air.sent, air.lost, air.collided,
+               air.noisy, air.taken, air.crossed, crc_errors, srv_missed, door_missed,
+               SIM_SPECK64_CYCLES, sim_seconds(t), wall);
+    }
+    for(i=0; i<n.mcus; i++)
+        sim_mcu_free(n.mcu[i]);
+    return fault;
+}
@@ -0,0 +1,817 @@
+/******************************************************************************
+ * smssim - run an SMS Server/Client firmware image on the host
+ *
+ *   smssim [-t seconds] [-b baud] [-e pct] [-u text] [-c cmds] [-i ms] [-d ms]
+ *          [-r ms] [-a ms] [-n node] [-2 ms] [-l pct] [-j ch:pct] [-y] [-s] [-p] [-F] [-q]
+ *          [-P] [-K] image.so
+ *
+ *   -t   simulated time to run (default 1s)
+ *   -b   baud rate of the host side of the software UART (default 2400)
+ *   -e   percent to make the bits the host sends longer (or shorter, if
+ *        negative) than -b says, to find the firmware's receive tolerance
+ *   -u   bytes to send to the firmware's RXD, and copy its TXD to stdout as is
+ *   -c   server commands to send as frames tagged 1, 2..., each one once
+ *        the reply to the one before is in, sent again after 150ms without
+ *        one: comma separated open[:node], close, status, config:tries:ms
+ *        (see cmd.h), open is for node 1; wait:ms holds the next one back;
+ *        cmd*N sends N of them (255 commands at most)
+ *   -i   with -c, send a command every N ms whether the replies are in or not,
+ *        to load RXD and TXD at the same time, and report the throughput
+ *   -d   when to start sending -u or -c (default 100ms, after the banner)
+ *   -r   stub RF-24G server: send MSG_OPEN every N ms, count the acks
+ *   -n   with -r, the door node to send to (default 1, the client's)
+ *   -y   with -r, keep replaying the first MSG_OPEN instead
+ *   -a   stub RF-24G clients: ack every MSG_OPEN the image sends on the channel
+ *        they listen on, N ms later, as whichever node it was sent to; then
+ *        follow MSG_HOP like the client
+ *   -2   broadcast on data channel 2 every N ms, for RF_24G_RX2 images
+ *   -l   percent of packets lost on the air, either way (default 0)
+ *   -j   and on RF channel ch, e.g. 25:80, Wi-Fi on it
+ *   -s   the image was built with RF_24G_USI (RF-24G wired to the USI)
+ *   -p   print the per-function cycle profile when done, with -F
+ *   -F   run every turn of a polling loop instead of skipping to the next
+ *        event (skip_spins, sim.h)
+ *   -q   do not print the firmware's frames: the replies, events, its log
+ *        (log.h) and profile (prof.h) with the text put back
+ *   -P   bridge the firmware's UART to a pseudo-terminal, named on stderr,
+ *        and run in real time, until interrupted or for -t seconds if given
+ *   -K   leave the door key in info memory erased; the image should not start
+ *
+ * The image gets SIM_DOOR_KEY at INFO_KEY_ADDR (door.h), and its speck64()
+ * calls are charged SIM_SPECK64_CYCLES each, an estimate (sim.h).
+ *
+ * With -P the gateway or a terminal program talks to the firmware over the
+ * pty as it would over a serial port. The pty is raw and starts at -b baud;
+ * if the other end sets another speed, the host side of the UART follows it
+ * and the firmware sees the garbage a real port would give (for speeds with
+ * a termios B constant; -b 76800 stays put). What the other end writes
+ * reaches RXD at the end of the 1 ms slice it arrived in, and what the
+ * firmware sends is written out as each stop bit is decoded, so the
+ * latencies measured at the other end are the firmware's plus up to 1 ms.
+ ******************************************************************************/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include "sim.h"
+#include "uart.h"
+#include "rfsrc.h"
+#include "../SMS Server/door.h"
+#include "../SMS Server/mac.h"
+#include "../SMS Server/cmd.h"
+#include "../SMS Server/log.h"
+#include "../SMS Server/prof.h"
+
+#define TXD     0x02    // P1.1
+#define RXD     0x04    // P1.2
+#define SLICE   SIM_PS_PER_MS
+#define PAYLOAD (MSG_MAC + MAC_LEN)       // RF_24G_PAYLOADSIZE
+
+static const uint32_t key[4] = SIM_DOOR_KEY;
+static const uint8_t hops[HOP_COUNT] = HOP_CHANNELS;
+
+struct peer {
+    uint32_t counter;           // last one sent (-r) or opened for (-a)
+    uint8_t node;               // door sent to (-r)
+    int ch;                     // RF channel the stub client listens on (-a)
+    unsigned deaf;              // opens it missed on the others
+    double ack_ms;
+    int replay;
+    unsigned sent, opens, acks, stale, bad;
+
+    //the MCU's packet on the air now, taken once it is all out
+    struct sim_rfsrc *r;
+    int pending;
+    uint8_t pkt[PAYLOAD];
+    uint8_t to;                 // low address byte clocked out
+    int rf_ch;
+    uint64_t t, end;            // CE dropped, last bit out
+};
+
+//MAC over the message and the door's node, as door.c: the block is the 6
+//bytes before MSG_MAC and the node, zero padded, and the tag its x word
+static void msg_mac(const uint8_t *p, uint8_t node, uint8_t *tag)
+{
+    uint32_t x = (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+    uint32_t y = (uint32_t)p[4] << 24 | p[5] << 16 | node << 8;
+    speck64(key, &x, &y);
+    tag[0] = x >> 24;
+    tag[1] = x >> 16;
+    tag[2] = x >> 8;
+    tag[3] = x;
+}
+
+static void msg(uint8_t *p, uint8_t type, uint32_t counter, uint8_t hop, uint8_t node)
+{
+    p[MSG_TYPE] = type;
+    p[MSG_COUNTER] = counter >> 24;
+    p[MSG_COUNTER+1] = counter >> 16;
+    p[MSG_COUNTER+2] = counter >> 8;
+    p[MSG_COUNTER+3] = counter;
+    p[MSG_HOP] = hop;
+    msg_mac(p, node, &p[MSG_MAC]);
+}
+
+//type of a packet from the MCU, 0 if it is not authentic for door node
+static uint8_t msg_type(const uint8_t *p, uint8_t node, uint32_t *counter)
+{
+    uint8_t tag[MAC_LEN];
+    msg_mac(p, node, tag);
+    if(memcmp(tag, &p[MSG_MAC], MAC_LEN))
+        return 0;
+    *counter = (uint32_t)p[MSG_COUNTER] << 24 | (uint32_t)p[MSG_COUNTER+1] << 16
+             | (uint32_t)p[MSG_COUNTER+2] << 8 | p[MSG_COUNTER+3];
+    return p[MSG_TYPE];
+}
+
+//stub server: a new counter for every MSG_OPEN, unless replaying the first
+static void peer_next(void *ctx, struct sim_rfsrc *r, uint8_t *payload,
+                      int len, uint64_t t)
+{
+    struct peer *p = ctx;
+    (void)r;
+    (void)len;
+    (void)t;
+    p->sent++;
+    if(!p->replay || !p->counter)
+        msg(payload, MSG_OPEN, ++p->counter, 0, p->node);
+}
+
+//the MCU's channel 1 address with node in place of ADDR1_0
+static void node_addr(struct sim_rfsrc *r, uint8_t node, uint8_t *addr)
+{
+    memcpy(addr, r->ch[0].addr, RF_MAX_ADDR);
+    addr[RF_MAX_ADDR - 1] = node;
+}
+
+static void peer_heard(void *ctx, struct sim_mcu *m, uint64_t now)
+{
+    struct peer *p = ctx;
+    struct sim_rfsrc *r = p->r;
+    uint8_t ack[PAYLOAD], addr[RF_MAX_ADDR], *payload = p->pkt, to = p->to;
+    uint64_t t = p->t;
+    uint32_t counter;
+    (void)m;
+    if(!p->pending || now < p->end)
+        return;                                 // aborted, or an older one's
+    p->pending = 0;
+    //from a door its acks and stales, to a door its opens
+    switch(msg_type(payload, to == SERVER_NODE ? p->node : to, &counter)){
+    case MSG_ACK:
+        if(counter == p->counter)
+            p->acks++;
+        break;
+    case MSG_STALE:
+        p->stale++;
+        break;
+    case MSG_OPEN:
+        //stub client: the door opens now, the ack goes back a little later
+        //on the same channel, then it moves to the server's home channel
+        if(p->ack_ms <= 0)
+            break;
+        if(p->rf_ch != p->ch){
+            p->deaf++;
+            break;
+        }
+        p->opens++;
+        if(counter > p->counter)
+            p->counter = counter;
+        msg(ack, MSG_ACK, counter, payload[MSG_HOP], to);
+        node_addr(r, SERVER_NODE, addr);
+        sim_rfsrc_send(r, t + (uint64_t)(p->ack_ms * SIM_PS_PER_MS), p->rf_ch, addr,
+                       ack, PAYLOAD);
+        p->ch = hops[payload[MSG_HOP] % HOP_COUNT];
+        break;
+    default:
+        p->bad++;
+        break;
+    }
+}
+
+//the stub peers only hear a packet once it is all on the air
+static void peer_recv(void *ctx, struct sim_rfsrc *r, uint8_t *payload,
+                      int len, uint64_t t)
+{
+    struct peer *p = ctx;
+    if(len < PAYLOAD)
+        return;
+    p->r = r;
+    p->pending = 1;
+    memcpy(p->pkt, payload, PAYLOAD);
+    p->to = r->txbuf[r->addr_bytes - 1];
+    p->rf_ch = r->tx_ch;
+    p->t = t;
+    p->end = r->tx_end;
+    sim_at(r->m, r->tx_end, peer_heard, p);
+}
+
+static void peer_cut(void *ctx, struct sim_rfsrc *r, uint64_t t)
+{
+    struct peer *p = ctx;
+    (void)r;
+    (void)t;
+    p->pending = 0;
+}
+
+//channel 2 broadcasts: a sequence number, to the MCU's channel 2 address
+struct bcast {
+    struct sim_rfsrc *r;
+    uint64_t period;
+    unsigned sent;
+};
+
+static void bcast_tick(void *ctx, struct sim_mcu *m, uint64_t t)
+{
+    struct bcast *b = ctx;
+    uint8_t payload[RF_MAX_PAYLOAD];
+    memset(payload, 0, sizeof(payload));
+    payload[0] = ++b->sent;
+    sim_rfsrc_send(b->r, t, b->r->rf_ch + RF_CH2_OFFSET, b->r->ch[1].addr,
+                   payload, RF_MAX_PAYLOAD);
+    sim_at(m, t + b->period, bcast_tick, b);
+}
+
+static void echo(void *ctx, uint8_t c, uint64_t t)
+{
+    (void)ctx;
+    (void)t;
+    putchar(c);
+    fflush(stdout);
+}
+
+//host side of the framed command protocol
+#define HOST_TIMEOUT    (150 * SIM_PS_PER_MS)
+#define HOST_CMDS       255     // tags are a byte, 0 is the firmware's
+
+struct host {
+    struct sim_uart *uart;
+    uint64_t deadline;          // for the reply to the last command sent
+    int waiting;
+    unsigned retries;
+    uint64_t t0;                // when the first command went out
+    int quiet;
+    uint8_t out[HOST_CMDS * 12];    // encoded commands
+    int start[HOST_CMDS + 1];   // where each one starts, and the end
+    uint64_t pause[HOST_CMDS];  // wait before sending it
+    int ncmds, next;
+    uint64_t every;             // -i: send one this often, don't wait
+    unsigned sent, replies;     // bytes to the firmware, replies to them
+    uint8_t buf[32];
+    int len, esc;
+    unsigned bytes, frames, bad;
+    uint64_t last;              // end of the last frame
+    unsigned opens, acked, tries;   // from the CMD_OPEN events
+    unsigned events, lost;      // CMD_LOG
+    unsigned profs;             // CMD_PROF
+};
+
+#define LOG_TEXT(id, level, text)   text,
+static const char *log_text[] = { LOG_EVENTS(LOG_TEXT) };
+#define PROF_NAME(slot, name)       name,
+static const char *prof_name[] = { PROF_SLOTS(PROF_NAME) };
+
+//CMD_PROF|CMD_EVENT: slot, calls, min, max, mean; times in Timer_A ticks,
+//SMCLK/8
+static void prof_print(const uint8_t *p, unsigned mclk_hz)
+{
+    double us = 8e6 / mclk_hz;
+    unsigned calls = p[1] << 8 | p[2];
+    printf("prof %-20s %5u calls, min/avg/max %.0f/%.0f/%.0f us\n", prof_name[p[0]], calls,
+           (p[3] << 8 | p[4]) * us, (p[7] << 8 | p[8]) * us, (p[5] << 8 | p[6]) * us);
+}
+
+static uint8_t frame_crc(const uint8_t *p, int n)
+{
+    uint8_t crc = 0;
+    int i;
+    while(n--){
+        crc ^= *p++;
+        for(i=0; i<8; i++)
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+}
+
+static int slip_put(uint8_t *out, uint8_t c)
+{
+    if(c == SLIP_END || c == SLIP_ESC){
+        out[0] = SLIP_ESC;
+        out[1] = c == SLIP_END ? SLIP_ESC_END : SLIP_ESC_ESC;
+        return 2;
+    }
+    out[0] = c;
+    return 1;
+}
+
+//encodes the -c list into h->out, returns -1 if it could not
+static int host_encode(struct host *h, const char *cmds)
+{
+    char *list = strdup(cmds), *tok, *save = NULL;
+    int n = 0, tag = 0, max = sizeof(h->out);
+    uint64_t wait = 0;
+    uint8_t *out = h->out;
+    for(tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save)){
+        uint8_t body[FRAME_MAX + 1];            //and the CRC
+        unsigned tries, ms, node, count = 1;
+        char *star = strchr(tok, '*');
+        int len = 2, i;
+        if(sscanf(tok, "wait:%u", &ms) == 1){
+            wait += (uint64_t)ms * SIM_PS_PER_MS;
+            continue;
+        }
+        if(star){
+            *star = 0;
+            count = atoi(star + 1);
+        }
+        if(!strcmp(tok, "open") || sscanf(tok, "open:%u", &node) == 1){
+            body[1] = CMD_OPEN;
+            body[2] = !strcmp(tok, "open") ? 1 : node;
+            len = 3;
+        }else if(!strcmp(tok, "close")){
+            body[1] = CMD_CLOSE;
+        }else if(!strcmp(tok, "status")){
+            body[1] = CMD_STATUS;
+        }else if(sscanf(tok, "config:%u:%u", &tries, &ms) == 2){
+            body[1] = CMD_CONFIG;
+            body[2] = tries;
+            body[3] = ms >> 8;
+            body[4] = ms;
+            len = 5;
+        }else{
+            fprintf(stderr, "smssim: unknown command '%s'\n", tok);
+            free(list);
+            return -1;
+        }
+        for(; count; count--){
+            body[0] = ++tag;
+            body[len] = frame_crc(body, len);
+            if(n + 2 * (len + 1) + 2 > max || h->ncmds >= HOST_CMDS)
+                break;
+            h->pause[h->ncmds] = wait;
+            h->start[h->ncmds++] = n;
+            wait = 0;
+            out[n++] = SLIP_END;
+            for(i=0; i<=len; i++)
+                n += slip_put(out + n, body[i]);
+            out[n++] = SLIP_END;
+        }
+    }
+    free(list);
+    h->start[h->ncmds] = n;
+    return 0;
+}
+
+static void host_timeout(void *ctx, struct sim_mcu *m, uint64_t t);
+
+static void host_frame(struct host *h, int i, uint64_t t)
+{
+    sim_uart_send(h->uart, t, h->out + h->start[i], h->start[i+1] - h->start[i]);
+    h->sent += h->start[i+1] - h->start[i];
+    if(h->every)
+        return;
+    h->waiting = 1;
+    h->deadline = t + HOST_TIMEOUT;
+    sim_at(h->uart->m, h->deadline, host_timeout, h);
+}
+
+//Wait for each reply, and send the command again if it doesn't come: the
+//frame or the reply may have been lost (an rxOverrun, say).
+static void host_send(struct host *h, uint64_t t)
+{
+    int i = h->next++;
+    h->waiting = 0;
+    if(i < h->ncmds)
+        host_frame(h, i, t + h->pause[i]);
+}
+
+//-i: keep RXD busy on a timer, whatever TXD is doing
+static void host_tick(void *ctx, struct sim_mcu *m, uint64_t t)
+{
+    struct host *h = ctx;
+    int i = h->next++;
+    if(i >= h->ncmds)
+        return;
+    t += h->pause[i];
+    host_frame(h, i, t);
+    sim_at(m, t + h->every, host_tick, h);
+}
+
+static void host_timeout(void *ctx, struct sim_mcu *m, uint64_t t)
+{
+    struct host *h = ctx;
+    (void)m;
+    if(!h->waiting || t < h->deadline)
+        return;
+    h->retries++;
+    host_frame(h, h->next - 1, t);
+}
+
+static void host_recv(void *ctx, uint8_t c, uint64_t t)
+{
+    struct host *h = ctx;
+    int i, log;
+    h->bytes++;
+    if(c == SLIP_END){
+        if(h->len >= 2 && frame_crc(h->buf, h->len - 1) == h->buf[h->len - 1]){
+            h->frames++;
+            h->last = t;
+            if(h->buf[1] == (CMD_OPEN | CMD_EVENT) && h->len >= 5){
+                h->opens++;
+                h->acked += !!(h->buf[2] & FLAG_ACKED);
+                h->tries += h->buf[3];
+            }
+            h->replies += !!(h->buf[1] & CMD_REPLY);
+            log = h->buf[1] == (CMD_LOG | CMD_EVENT) && h->len == 6 && h->buf[2] < EV_COUNT;
+            if(log){
+                h->events++;
+                if(h->buf[2] == EV_LOST)
+                    h->lost += h->buf[3] << 8 | h->buf[4];
+            }
+            if(!h->every && (h->buf[1] & CMD_REPLY) && h->buf[0] == h->next)
+                host_send(h, t);
+            if(h->quiet){
+            }else if(log){
+                printf("%9.2f ms   ", (t - (double)h->t0) / SIM_PS_PER_MS);
+                printf(log_text[h->buf[2]], h->buf[3] << 8 | h->buf[4]);
+                printf("\n");
+            }else if(h->buf[1] == (CMD_PROF | CMD_EVENT) && h->len == 12 && h->buf[2] < PROF_COUNT){
+                h->profs++;
+                printf("%9.2f ms   ", (t - (double)h->t0) / SIM_PS_PER_MS);
+                prof_print(h->buf + 2, h->uart->m->mclk_hz);
+            }else{
+                printf("%9.2f ms <", (t - (double)h->t0) / SIM_PS_PER_MS);
+                for(i=0; i<h->len - 1; i++)
+                    printf(" %02x", h->buf[i]);
+                printf("\n");
+            }
+        }else if(h->len){
+            h->bad++;
+        }
+        h->len = h->esc = 0;
+    }else if(c == SLIP_ESC){
+        h->esc = 1;
+    }else{
+        if(h->esc)
+            c = c == SLIP_ESC_END ? SLIP_END : c == SLIP_ESC_ESC ? SLIP_ESC : c;
+        h->esc = 0;
+        if(h->len < (int)sizeof(h->buf))
+            h->buf[h->len++] = c;
+    }
+}
+
+//-P: the firmware's UART on a pty, in real time
+struct bridge {
+    struct sim_uart *uart;
+    struct host *host;          // watches the frames go by
+    int master, slave;
+    const char *name;
+    unsigned baud;              // the pty's, as the other end last set it
+    double skew;                // -e
+    struct timespec t0;
+    unsigned in, out, dropped;  // bytes, dropped with nobody reading
+    uint64_t behind;            // worst ps the simulation fell behind
+};
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+static const struct {
+    unsigned baud;
+    speed_t speed;
+} speeds[] = {
+    { 1200, B1200 }, { 2400, B2400 }, { 4800, B4800 }, { 9600, B9600 },
+    { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 }, { 115200, B115200 },
+};
+
+//0 for speeds the table has no baud for
+static unsigned speed_baud(speed_t speed)
+{
+    unsigned i;
+    for(i=0; i<sizeof(speeds)/sizeof(speeds[0]); i++)
+        if(speeds[i].speed == speed)
+            return speeds[i].baud;
+    return 0;
+}
+
+static void bridge_recv(void *ctx, uint8_t c, uint64_t t)
+{
+    struct bridge *b = ctx;
+    if(write(b->master, &c, 1) == 1)
+        b->out++;
+    else
+        b->dropped++;
+    host_recv(b->host, c, t);
+}
+
+//the slave is held open, so the other end can come and go without the
+//master seeing a hangup, and made raw, so that bytes pass as they are; the
+//other end may change that
+static int bridge_open(struct bridge *b, unsigned baud)
+{
+    struct termios tio;
+    unsigned i;
+    b->master = posix_openpt(O_RDWR | O_NOCTTY);
+    if(b->master < 0 || grantpt(b->master) || unlockpt(b->master)
+       || !(b->name = ptsname(b->master))
+       || (b->slave = open(b->name, O_RDWR | O_NOCTTY)) < 0
+       || tcgetattr(b->slave, &tio)){
+        perror("smssim: pty");
+        return -1;
+    }
+    cfmakeraw(&tio);
+    for(i=0; i<sizeof(speeds)/sizeof(speeds[0]); i++)
+        if(speeds[i].baud == baud)
+            cfsetspeed(&tio, speeds[i].speed);
+    tcsetattr(b->slave, TCSANOW, &tio);
+    fcntl(b->master, F_SETFL, O_NONBLOCK);
+    b->baud = speed_baud(cfgetospeed(&tio));
+    clock_gettime(CLOCK_MONOTONIC, &b->t0);
+    return 0;
+}
+
+static uint64_t bridge_wall(struct bridge *b)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)(ts.tv_sec - b->t0.tv_sec) * SIM_PS_PER_S
+           + (int64_t)(ts.tv_nsec - b->t0.tv_nsec) * 1000;
+}
+
+//the pty's speed, if the other end changed it
+static void bridge_speed(struct bridge *b)
+{
+    struct termios tio;
+    unsigned baud;
+    if(tcgetattr(b->slave, &tio) || !(baud = speed_baud(cfgetospeed(&tio))) || baud == b->baud)
+        return;
+    b->baud = baud;
+    b->uart->bit = SIM_PS_PER_S / baud;
+    b->uart->tx_bit = (uint64_t)(b->uart->bit * (1 + b->skew / 100));
+    fprintf(stderr, "smssim: %s now at %u baud\n", b->name, baud);
+}
+
+//Waits for the wall clock to catch up with the simulation at t, which has
+//run up to now, passing on what the other end writes as it comes.
+static void bridge_wait(struct bridge *b, uint64_t now, uint64_t t)
+{
+    struct pollfd pfd;
+    uint8_t buf[256];
+    uint64_t wall;
+    ssize_t n;
+    bridge_speed(b);
+    pfd.fd = b->master;
+    pfd.events = POLLIN;
+    while(!stop){
+        struct timespec ts = { 0, 0 };
+        wall = bridge_wall(b);
+        if(wall < t){
+            ts.tv_sec = (t - wall) / SIM_PS_PER_S;
+            ts.tv_nsec = (t - wall) % SIM_PS_PER_S / 1000;
+        }else if(wall - t > b->behind){
+            b->behind = wall - t;
+        }
+        if(ppoll(&pfd, 1, &ts, NULL) <= 0)
+            break;
+        if((n = read(b->master, buf, sizeof(buf))) <= 0)
+            break;
+        sim_uart_send(b->uart, now, buf, n);
+        b->in += n;
+        if(wall >= t)
+            break;
+    }
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: smssim [-t seconds] [-b baud] [-e pct] [-u text] [-c cmds] [-i ms] [-d ms]\n"
+                    "              [-r ms] [-a ms] [-n node] [-2 ms] [-l pct] [-j ch:pct] [-y] [-s] [-p] [-F]\n"
+                    "              [-q] [-P] [-K]\n"
+                    "              image.so\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 0;
+    unsigned baud = 2400;
+    double skew = 0;
+    const char *text = NULL;
+    const char *cmds = NULL;
+    double rf_ms = 0;
+    double delay_ms = 100;
+    double every_ms = 0;
+    unsigned loss = 0, jam = 0;
+    int jam_ch = -1;
+    int prof = 0, quiet = 0, usi = 0, spins = 1, pty = 0, keyless = 0;
+    struct sim_mcu *m;
+    struct sim_uart uart;
+    struct sim_rfsrc rf;
+    struct peer peer;
+    struct host host;
+    struct bcast bcast;
+    struct bridge bridge;
+    uint64_t end, t, step;
+    int c, ret;
+
+    memset(&peer, 0, sizeof(peer));
+    memset(&host, 0, sizeof(host));
+    memset(&bcast, 0, sizeof(bcast));
+    memset(&bridge, 0, sizeof(bridge));
+    peer.node = 1;
+    peer.ch = hops[0];
+    while((c = getopt(argc, argv, "t:b:e:u:c:i:d:r:a:n:2:l:j:yspFqPK")) != -1){
+        switch(c){
+        case 't': seconds = atof(optarg); break;
+        case 'b': baud = atoi(optarg); break;
+        case 'e': skew = atof(optarg); break;
+        case 'u': text = optarg; break;
+        case 'c': cmds = optarg; break;
+        case 'i': every_ms = atof(optarg); break;
+        case 'd': delay_ms = atof(optarg); break;
+        case 'r': rf_ms = atof(optarg); break;
+        case 'a': peer.ack_ms = atof(optarg); break;
+        case 'n': peer.node = atoi(optarg); break;
+        case '2': bcast.period = (uint64_t)(atof(optarg) * SIM_PS_PER_MS); break;
+        case 'l': loss = atoi(optarg); break;
+        case 'j':
+            if(sscanf(optarg, "%d:%u", &jam_ch, &jam) != 2)
+                usage();
+            break;
+        case 'y': peer.replay = 1; break;
+        case 's': usi = 1; break;
+        case 'p': prof = 1; spins = 0; break;
+        case 'F': spins = 0; break;
+        case 'q': quiet = 1; break;
+        case 'P': pty = 1; break;
+        case 'K': keyless = 1; break;
+        default: usage();
+        }
+    }
+    if(optind != argc - 1 || !baud || (pty && (text || cmds)))
+        usage();
+    if(!seconds && !pty)
+        seconds = 1.0;
+
+    m = sim_mcu_new(argv[optind], argv[optind]);
+    if(!m || !m->entry)
+        return 1;
+    if(!keyless)
+        sim_mcu_info32(m, INFO_KEY_ADDR, key, 4);
+    sim_mcu_charge(m, "speck64", SIM_SPECK64_CYCLES);
+    m->skip_spins = spins;
+
+    memset(&uart, 0, sizeof(uart));
+    sim_uart_init(&uart, m, TXD, RXD, baud);
+    uart.tx_bit = (uint64_t)(uart.bit * (1 + skew / 100));
+    if(cmds){
+        if(host_encode(&host, cmds) < 0)
+            return 2;
+        host.uart = &uart;
+        host.t0 = (uint64_t)(delay_ms * SIM_PS_PER_MS);
+        host.quiet = quiet;
+        host.every = (uint64_t)(every_ms * SIM_PS_PER_MS);
+        uart.recv = host_recv;
+        uart.ctx = &host;
+        if(host.every)
+            sim_at(m, host.t0, host_tick, &host);
+        else
+            host_send(&host, host.t0);
+    }else if(text){
+        if(!quiet)
+            uart.recv = echo;
+    }else if(pty){
+        if(bridge_open(&bridge, baud) < 0)
+            return 1;
+        host.quiet = quiet;
+        bridge.uart = &uart;
+        bridge.host = &host;
+        bridge.skew = skew;
+        uart.recv = bridge_recv;
+        uart.ctx = &bridge;
+        signal(SIGINT, on_signal);
+        signal(SIGTERM, on_signal);
+        fprintf(stderr, "smssim: %s, %u baud\n", bridge.name, baud);
+    }else{
+        host.quiet = quiet;
+        uart.recv = host_recv;
+        uart.ctx = &host;
+    }
+    if(text)
+        sim_uart_send(&uart, (uint64_t)(delay_ms * SIM_PS_PER_MS), text, strlen(text));
+    sim_rfsrc_init(&rf, m, usi);
+    rf.loss = loss;
+    rf.jam_ch = jam_ch;
+    rf.jam = jam;
+    rf.ctx = &peer;
+    rf.recv = peer_recv;
+    rf.cut = peer_cut;
+    if(rf_ms > 0){
+        uint8_t payload[PAYLOAD], addr[RF_MAX_ADDR];
+        uint64_t period = (uint64_t)(rf_ms * SIM_PS_PER_MS);
+        msg(payload, MSG_OPEN, 1, 0, peer.node);
+        node_addr(&rf, peer.node, addr);
+        rf.next = peer_next;
+        sim_rfsrc_periodic(&rf, period, period, hops[0], addr, payload, PAYLOAD);
+    }
+    if(bcast.period){
+        bcast.r = &rf;
+        sim_at(m, bcast.period, bcast_tick, &bcast);
+    }
+
+    //the host, the peer and the UART decoder all run off the MCU's own events
+    //(sim_at, pin watches), so it runs to the end in one go; only the pty
+    //needs it back every SLICE, for its input and to keep to the wall clock
+    end = seconds > 0 ? (uint64_t)(seconds * SIM_PS_PER_S) : UINT64_MAX;
+    step = pty ? SLICE : end;
+    for(t=0; t<end && !stop; ){
+        t = t + step < end ? t + step : end;
+        if(sim_mcu_run(m, t))
+            break;
+        sim_uart_flush(&uart, m->now);
+        if(pty)
+            bridge_wait(&bridge, m->now, t);
+    }
+    if(!quiet && text)
+        putchar('\n');
+
+    fprintf(stderr, "%s: %.6f s, %llu cycles, MCLK %u Hz%s%s\n", m->name,
+            sim_seconds(m->now), (unsigned long long)m->cycles, m->mclk_hz,
+            m->fault ? ", stopped: " : "", m->fault ? m->fault : "");
+    if(m->spun_ps)
+        fprintf(stderr, "sim: %.1f%% of it skipped in polling loops\n", 100.0 * m->spun_ps / m->now);
+    if(uart.framing)
+        fprintf(stderr, "uart: %u framing errors\n", uart.framing);
+    if(uart.frames)
+        fprintf(stderr, "uart: %u bytes at %u baud from the firmware, TXD edges up to %.1f%% of a bit off\n",
+                uart.frames, (unsigned)(SIM_PS_PER_S / uart.bit), 100.0 * uart.skew / uart.bit);
+    if(cmds)
+        fprintf(stderr, "uart: %u bytes, %u frames (%u bad) from the firmware, last %.2f ms, %u commands sent again\n",
+                host.bytes, host.frames, host.bad, (host.last - (double)host.t0) / SIM_PS_PER_MS, host.retries);
+    if(cmds && host.last > host.t0)
+        fprintf(stderr, "uart: %u of %u commands answered, %.0f bytes/s in and %.0f out\n",
+                host.replies, host.ncmds, host.sent * (double)SIM_PS_PER_S / (host.last - host.t0),
+                host.bytes * (double)SIM_PS_PER_S / (host.last - host.t0));
+    if(pty)
+        fprintf(stderr, "pty: %u bytes in, %u out, %u dropped with nothing reading, up to %.1f ms behind real time\n",
+                bridge.in, bridge.out, bridge.dropped, bridge.behind / 1e9);
+    if(host.events)
+        fprintf(stderr, "log: %u events, %u more lost in the firmware\n", host.events, host.lost);
+    if(host.profs)
+        fprintf(stderr, "prof: %u slots, their times are %s\n", host.profs, SIM_LOWER_BOUND);
+    if(host.opens)
+        fprintf(stderr, "opens: %u of %u acked, %.1f tries each\n",
+                host.acked, host.opens, (double)host.tries / host.opens);
+    if(rf.ch[0].sent)
+        fprintf(stderr, "rf: %u packets read, DR1 to first CLK1 min/avg/max %.1f/%.1f/%.1f us\n",
+                rf.ch[0].sent, rf.ch[0].lat_min / 1e6, rf.ch[0].lat_sum / 1e6 / rf.ch[0].sent,
+                rf.ch[0].lat_max / 1e6);
+    else if(rf_ms > 0 || peer.opens)
+        fprintf(stderr, "rf: no packets read\n");
+    if(bcast.sent)
+        fprintf(stderr, "rf: %u of %u broadcasts read on channel 2, DR2 to first CLK2 max %.1f us\n",
+                rf.ch[1].sent, bcast.sent, rf.ch[1].lat_max / 1e6);
+    if(rf.ch[0].missed || rf.ch[1].missed || rf.dropped)
+        fprintf(stderr, "rf: %u arrived while not listening or not read, %u lost on the air\n",
+                rf.ch[0].missed + rf.ch[1].missed, rf.dropped);
+    if(rf.filtered)
+        fprintf(stderr, "rf: %u packets for other nodes or channels, no DR\n", rf.filtered);
+    if(rf.aborted)
+        fprintf(stderr, "rf: %u packets sent cut short by CS or CE before they were out\n",
+                rf.aborted);
+    if(rf.heard){
+        //times from the start of -u/-c, i.e. the open command
+        double t0 = text || cmds ? delay_ms * SIM_PS_PER_MS : 0;
+        fprintf(stderr, "rf: %u packets sent, %.1f us on the air, first %.2f ms, last %.2f ms\n",
+                rf.heard, rf.air_ps / 1e6, (rf.first_heard - t0) / 1e9,
+                (rf.last_heard - t0) / 1e9);
+    }
+    if(rf_ms > 0)
+        fprintf(stderr, "rf: %u of %u opens acked, %u stale\n",
+                peer.acks, peer.sent, peer.stale);
+    if(peer.bad)
+        fprintf(stderr, "rf: %u packets failed the MAC\n", peer.bad);
+    if(peer.opens && rf.ch[0].sent)
+        fprintf(stderr, "rf: %u opens heard and acked, last ack read %.2f ms\n",
+                peer.opens, (rf.ch[0].last_read - delay_ms * SIM_PS_PER_MS) / 1e9);
+    else if(peer.opens)
+        fprintf(stderr, "rf: %u opens heard and acked\n", peer.opens);
+    if(peer.deaf)
+        fprintf(stderr, "rf: %u opens on channels the stub client was not on\n", peer.deaf);
+    sim_power_print(m, stderr);
+    if(prof)
+        sim_prof_print(m, stderr);
+    ret = m->fault ? 1 : 0;
+    sim_mcu_free(m);
+    return ret;
+}
@@ -0,0 +1,108 @@
+/******************************************************************************
+ * Line-level UART attached to the simulated software UART pins
+ ******************************************************************************/
+#include "uart.h"
+
+//sample every bit whose centre lies before time t at the current line level
+static void uart_decode(struct sim_uart *u, uint64_t t)
+{
+    while(u->state >= 0){
+        uint64_t ts = u->t0 + u->bit/2 + u->state * u->bit;
+        if(ts >= t)
+            break;
+        if(u->state == 0){
+            if(u->level){
+                u->state = -1;          // glitch, not a start bit
+                break;
+            }
+        }else if(u->state <= 8){
+            u->shift >>= 1;
+            if(u->level)
+                u->shift |= 0x80;
+        }else{
+            if(!u->level)
+                u->framing++;
+            else{
+                u->frames++;
+                if(u->recv)
+                    u->recv(u->ctx, u->shift, ts);
+            }
+            u->state = -1;
+            break;
+        }
+        u->state++;
+    }
+}
+
+//decode the frame as its stop bit is sampled rather than at the next edge or
+//sim_uart_flush(), so whoever answers it sends on time
+static void uart_stop(void *ctx, struct sim_mcu *m, uint64_t t)
+{
+    (void)m;
+    uart_decode(ctx, t + 1);
+}
+
+static void uart_watch(void *ctx, struct sim_mcu *m, int port,
+                       uint8_t changed, uint8_t level, uint64_t t)
+{
+    struct sim_uart *u = ctx;
+    int lvl;
+    if(port != 1 || !(changed & u->txd))
+        return;
+    lvl = !!(level & u->txd);
+    uart_decode(u, t);
+    if(u->state >= 0){
+        //an edge inside the frame should be on a bit boundary
+        uint64_t dt = t - u->t0;
+        uint64_t k = (dt + u->bit/2) / u->bit;
+        uint64_t off = dt > k * u->bit ? dt - k * u->bit : k * u->bit - dt;
+        if(off > u->skew)
+            u->skew = off;
+    }
+    if(u->state < 0 && u->level && !lvl){
+        u->state = 0;
+        u->t0 = t;
+        u->shift = 0;
+        sim_at(m, t + u->bit/2 + 9 * u->bit, uart_stop, u);
+    }
+    u->level = lvl;
+}
+
+void sim_uart_init(struct sim_uart *u, struct sim_mcu *m,
+                   uint8_t txd, uint8_t rxd, unsigned baud)
+{
+    u->m = m;
+    u->txd = txd;
+    u->rxd = rxd;
+    u->bit = SIM_PS_PER_S / baud;
+    u->tx_bit = u->bit;
+    u->level = 1;
+    u->state = -1;
+    u->out = 1;
+    sim_pin_watch(m, uart_watch, u);
+}
+
+void sim_uart_send(struct sim_uart *u, uint64_t t, const void *buf, int n)
+{
+    const uint8_t *p = buf;
+    if(t < u->free_at)
+        t = u->free_at;
+    while(n-- > 0){
+        unsigned frame = (*p++ << 1) | 0x200;      // start, 8 data, stop
+        int i;
+        for(i=0; i<10; i++){
+            int lvl = (frame >> i) & 1;
+            if(lvl != u->out){
+                sim_pin_drive(u->m, t + i*u->tx_bit, 1, u->rxd, lvl);
+                u->out = lvl;
+            }
+        }
+        t += 10*u->tx_bit;
+    }
+    u->free_at = t;
+}
+
+void sim_uart_flush(struct sim_uart *u, uint64_t t)
+{
+    uart_decode(u, t);
+}
@@ -0,0 +1,40 @@
+/******************************************************************************
+ * Line-level UART attached to the simulated software UART pins
+ *
+ * Decodes the frames the firmware bit-bangs on TXD and drives frames onto RXD,
+ * both at a fixed host baud rate, 8N1, LSB first.
+ ******************************************************************************/
+#ifndef SIM_UART_H
+#define SIM_UART_H
+
+#include "sim.h"
+
+struct sim_uart {
+    struct sim_mcu *m;
+    uint8_t txd;                // MCU TXD pin on port 1
+    uint8_t rxd;                // MCU RXD pin on port 1
+    uint64_t bit;               // ps per bit
+    uint64_t tx_bit;            // ps per bit sent to the MCU, bit unless skewed
+
+    //MCU -> host
+    int level;
+    int state;                  // -1 idle, else bit being sampled (0 = start)
+    uint64_t t0;
+    uint8_t shift;
+    void (*recv)(void *ctx, uint8_t c, uint64_t t);
+    void *ctx;
+    unsigned framing;
+    unsigned frames;
+    uint64_t skew;              // worst TXD edge, ps off where BAUD puts it
+
+    //host -> MCU
+    uint64_t free_at;
+    int out;
+};
+
+void sim_uart_init(struct sim_uart *u, struct sim_mcu *m,
+                   uint8_t txd, uint8_t rxd, unsigned baud);
+void sim_uart_send(struct sim_uart *u, uint64_t t, const void *buf, int n);
+void sim_uart_flush(struct sim_uart *u, uint64_t t);
+
+#endif
@@ -0,0 +1,44 @@
+# Builds the simulator's interrupt vector table from the firmware sources.
+#
+#   #pragma vector=PORT1_VECTOR
+#   __interrupt void Port_1(void)
+#
+# becomes { PORT1_VECTOR, Port_1 } in sim_vectors[].
+
+/^[ \t]*#pragma[ \t]+vector[ \t]*=/ {
+    line = $0
+    sub(/.*vector[ \t]*=[ \t]*/, "", line)
+    gsub(/[ \t\r]/, "", line)
+    pending = line
+    next
+}
+
+pending != "" && /__interrupt/ {
+    if (match($0, /[A-Za-z_][A-Za-z0-9_]*[ \t]*\(/)) {
+        isr = substr($0, RSTART, RLENGTH)
+        sub(/[ \t]*\($/, "", isr)
+        n = split(pending, vecs, ",")
+        for (i = 1; i <= n; i++) {
+            count++
+            vec[count] = vecs[i]
+            fn[count] = isr
+        }
+        isrs[isr] = 1
+    }
+    pending = ""
+}
+
+END {
+    print "/* generated by vectors.awk - do not edit */"
+    print "#include \"msp430g2452.h\""
+    print "#include \"sim.h\""
+    print ""
+    for (isr in isrs)
+        print "void " isr "(void);"
+    print ""
+    print "const struct sim_vector sim_vectors[] = {"
+    for (i = 1; i <= count; i++)
+        print "    { " vec[i] ", " fn[i] " },"
+    print "    { -1, 0 }"
+    print "};"
+}